@@ -7,4 +7,6 @@ typedef union tree_node *tree;
 
 //typedef enum vomitorium_frontend vomitorium_frontend;
 typedef struct vomitorium_visitor vomitorium_visitor;
+typedef struct vomitorium_iter vomitorium_iter;
+typedef struct vomitorium_event vomitorium_event;
 typedef void *vomitorium_cookie;
@@ -0,0 +1,177 @@
+#pragma once
+
+// Reading vomitorium dumps, without GCC. Link with lib/vomitorium-reader.so.
+//
+// The dump is mmap()ed, and everything handed back to you points into the
+// mapping, so nothing is allocated or copied per node. The views are only
+// valid until vomitorium_reader_close().
+//
+// This only understands the XML that vomitorium writes: at most one
+// attribute per tag, no CDATA, no DTD. Comments and <?xml?> are skipped.
+// Compressed dumps (.gz, .zst) have to be decompressed first.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+// Opaque, and C++ inside; declared before the exported region so that
+// their members stay private to the library.
+typedef struct vomitorium_reader vomitorium_reader;
+typedef struct vomitorium_tokens vomitorium_tokens;
+
+#pragma GCC visibility push(default)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct vomitorium_reader_handler vomitorium_reader_handler;
+    typedef struct vomitorium_record vomitorium_record;
+    typedef struct vomitorium_string_view vomitorium_string_view;
+    typedef struct vomitorium_token vomitorium_token;
+
+    // Not NUL-terminated. Text and attribute values are still escaped;
+    // see vomitorium_reader_unescape().
+    struct vomitorium_string_view
+    {
+        const char *data;
+        size_t len;
+    };
+
+    struct vomitorium_reader_handler
+    {
+        // The size of this struct that *you* were compiled against.
+        size_t _size;
+
+        // Arbitrary user data.
+        void *user_data;
+
+        // Return false from any of these to stop parsing.
+
+        // `attr` and `value` are empty if the tag has no attribute.
+        // A self-closing tag gets an immediate call to `end`.
+        bool (*start)(vomitorium_reader_handler *self, vomitorium_string_view tag, vomitorium_string_view attr, vomitorium_string_view value);
+        // Indentation between tags is not reported.
+        bool (*text)(vomitorium_reader_handler *self, vomitorium_string_view text);
+        bool (*end)(vomitorium_reader_handler *self, vomitorium_string_view tag);
+    };
+
+#define VOMITORIUM_READER_HANDLER_GET_FIELD(ptr, NAME) (offsetof(vomitorium_reader_handler, NAME) + sizeof((ptr)->NAME) <= (ptr)->_size ? (ptr)->NAME : NULL)
+
+    __attribute__((unused))
+    static void vomitorium_reader_handler_init(vomitorium_reader_handler *handler)
+    {
+        memset(handler, 0, sizeof(*handler));
+        handler->_size = sizeof(*handler);
+    }
+
+    // A top-level element: <vomitorium-dump>, <vomitorium-gimple>, ...
+    struct vomitorium_record
+    {
+        // The size of this struct that *you* were compiled against.
+        size_t _size;
+
+        vomitorium_string_view tag;
+        // Of the whole element, in the file.
+        size_t offset;
+        size_t length;
+    };
+
+    __attribute__((unused))
+    static void vomitorium_record_init(vomitorium_record *record)
+    {
+        memset(record, 0, sizeof(*record));
+        record->_size = sizeof(*record);
+    }
+
+
+    // ABI-visible, so explicitly assign values
+    enum vomitorium_token_kind
+    {
+        VOMITORIUM_TOKEN_NONE = 0,      // finished, or malformed
+        VOMITORIUM_TOKEN_START = 1,     // tag, attr, value
+        VOMITORIUM_TOKEN_TEXT = 2,      // text
+        VOMITORIUM_TOKEN_END = 3,       // tag
+    };
+    typedef enum vomitorium_token_kind vomitorium_token_kind;
+
+    // The pull-style equivalent of one vomitorium_reader_handler callback.
+    struct vomitorium_token
+    {
+        // The size of this struct that *you* were compiled against.
+        size_t _size;
+
+        vomitorium_token_kind kind;
+        // Of the element that this starts, ends or is the text of;
+        // the first element is at depth 0.
+        size_t depth;
+        vomitorium_string_view tag;
+        vomitorium_string_view attr;
+        vomitorium_string_view value;
+        vomitorium_string_view text;
+    };
+
+    __attribute__((unused))
+    static void vomitorium_token_init(vomitorium_token *token)
+    {
+        memset(token, 0, sizeof(*token));
+        token->_size = sizeof(*token);
+    }
+
+
+    // Returns NULL and sets errno on failure.
+    vomitorium_reader *vomitorium_reader_open(const char *path);
+    void vomitorium_reader_close(vomitorium_reader *reader);
+
+    // The whole file.
+    vomitorium_string_view vomitorium_reader_data(vomitorium_reader *reader);
+    // Whether the dump was written with -fplugin-arg-vomitorium-index.
+    bool vomitorium_reader_has_index(vomitorium_reader *reader);
+
+    // Parse the whole file, in order. Returns false if a handler
+    // stopped the parse, or if the file isn't well-formed.
+    bool vomitorium_reader_parse(vomitorium_reader *reader, vomitorium_reader_handler *handler);
+
+    // Records come from the index if there is one. Otherwise, the first
+    // call scans the whole file for them.
+    size_t vomitorium_reader_record_count(vomitorium_reader *reader);
+    bool vomitorium_reader_record(vomitorium_reader *reader, size_t i, vomitorium_record *record);
+    // Records are independent, so it is fine to parse different ones
+    // from different threads at the same time.
+    bool vomitorium_reader_parse_record(vomitorium_reader *reader, size_t i, vomitorium_reader_handler *handler);
+
+    // Random access to <tree id="@N"> by N. Only works with an index;
+    // returns false if the tree was never dumped.
+    size_t vomitorium_reader_tree_count(vomitorium_reader *reader);
+    bool vomitorium_reader_parse_tree(vomitorium_reader *reader, size_t id, vomitorium_reader_handler *handler);
+
+    // Pull-style parsing, over the same ranges as the functions above.
+    // The begin functions return NULL where those would return false
+    // without parsing anything. Nothing is allocated per token.
+    vomitorium_tokens *vomitorium_reader_tokens(vomitorium_reader *reader);
+    vomitorium_tokens *vomitorium_reader_record_tokens(vomitorium_reader *reader, size_t i);
+    vomitorium_tokens *vomitorium_reader_tree_tokens(vomitorium_reader *reader, size_t id);
+    // Any range that starts and ends between tags, e.g. to split a record
+    // between threads. Elements may end in it without having started in
+    // it; their END tokens, and anything outside of every element that
+    // started in it, are at depth 0.
+    vomitorium_tokens *vomitorium_reader_range_tokens(vomitorium_reader *reader, size_t offset, size_t length);
+    // Returns false (and sets VOMITORIUM_TOKEN_NONE) when finished.
+    bool vomitorium_tokens_next(vomitorium_tokens *tokens, vomitorium_token *token);
+    // After the last token: whether the input was well-formed.
+    bool vomitorium_tokens_complete(vomitorium_tokens *tokens);
+    void vomitorium_tokens_end(vomitorium_tokens *tokens);
+
+    // Parse a reference of the form `@N`.
+    bool vomitorium_reader_tree_ref(vomitorium_string_view ref, size_t *id);
+    // `out` needs room for `in.len` bytes; returns how many were used.
+    size_t vomitorium_reader_unescape(vomitorium_string_view in, char *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma GCC visibility pop
@@ -0,0 +1,421 @@
+#pragma once
+
+// The tree walk behind vomitorium_visit() and vomitorium_iter_*(), for C++
+// plugins that want it compiled (and inlined) into their own code; see
+// vomitorium.hpp. Unlike vomitorium.h, this needs GCC's plugin headers
+// (include it after them), and ties you to the GCC you build against.
+//
+// Everything here is hidden, so each plugin calls its own copy rather
+// than vomitorium's.
+
+#include "vomitorium.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "vgcc/vgcc-version-check.h"
+#include "vgcc/tree.h"
+
+#pragma GCC visibility push(hidden)
+
+// Depth-first walk over trees, using an explicit stack instead of recursion.
+//
+// Every tree is reported once; later references to it are reported as
+// "again" events. A tree's children are pushed lazily, on the call to
+// next() *after* the tree was reported, so skip() costs nothing.
+//
+// Trees are numbered from 1 in the order the walk first reaches them.
+// These ids are local to the walk: a plain walk must not give trees dump
+// ids (that's what vomitorium_tree_id() is for), and the ids stay small and dense
+// for anyone indexing by them.
+class VomitoriumWalker
+{
+    struct Slot
+    {
+        const_tree t;
+        size_t id;
+    };
+
+    struct Item
+    {
+        vomitorium_event_kind kind; // NONE means "leave"
+        const char *name;
+        const void *data;
+        size_t len;
+    };
+
+    std::vector<Item> roots;
+    size_t next_root;
+    std::vector<Item> stack;
+    // Open addressing, keyed by pointer; a power of two in size, and never
+    // more than half full. Only grows, so there is nothing to allocate per
+    // tree except the occasional doubling.
+    std::vector<Slot> seen;
+    size_t seen_count;
+
+    const_tree pending;
+    // The tree from the last TREE or AGAIN event, for descend().
+    const_tree last;
+    size_t current_depth;
+public:
+    VomitoriumWalker();
+    VomitoriumWalker(const VomitoriumWalker&) = delete;
+    VomitoriumWalker& operator = (const VomitoriumWalker&) = delete;
+
+    void add_root(const char *name, const_tree t);
+    void add_global_roots();
+
+    bool next(vomitorium_event *event);
+    void skip();
+    // Walk the children of the last VOMITORIUM_EVENT_AGAIN tree after all.
+    // They are reported as AGAIN too, if they were already reported.
+    void descend();
+private:
+    void push_tree(const char *name, const_tree t);
+    void push_string(const char *name, const void *str, size_t len, size_t width);
+    void push_children(const_tree t);
+    size_t find_id(const_tree t, bool *is_new);
+    void grow_seen();
+};
+
+
+inline VomitoriumWalker::VomitoriumWalker()
+: next_root(0)
+, seen(64)
+, seen_count(0)
+, pending(NULL_TREE)
+, last(NULL_TREE)
+, current_depth(0)
+{
+}
+
+inline void VomitoriumWalker::add_root(const char *name, const_tree t)
+{
+    if (!t)
+        return;
+    Item item = {VOMITORIUM_EVENT_TREE, name, t, 0};
+    this->roots.push_back(item);
+}
+
+inline void VomitoriumWalker::add_global_roots()
+{
+    this->add_root("current_function_decl", current_function_decl);
+#if HAS_VGCC_VERSION(4, 8)
+    unsigned ix;
+    tree t;
+    FOR_EACH_VEC_SAFE_ELT(all_translation_units, ix, t)
+        this->add_root("all_translation_units", t);
+#elif HAS_VGCC_VERSION(4, 6)
+    unsigned ix;
+    tree t;
+    FOR_EACH_VEC_ELT(tree, all_translation_units, ix, t)
+        this->add_root("all_translation_units", t);
+#endif
+    for (int i = 0; i < TI_MAX; ++i)
+        this->add_root("global_trees", global_trees[i]);
+}
+
+inline bool VomitoriumWalker::next(vomitorium_event *event)
+{
+    if (this->pending)
+    {
+        this->push_children(this->pending);
+        this->pending = NULL_TREE;
+    }
+
+    while (true)
+    {
+        if (this->stack.empty())
+        {
+            if (this->next_root == this->roots.size())
+                break;
+            this->stack.push_back(this->roots[this->next_root++]);
+        }
+
+        Item item = this->stack.back();
+        this->stack.pop_back();
+        if (item.kind == VOMITORIUM_EVENT_NONE)
+        {
+            assert (this->current_depth);
+            this->current_depth--;
+            continue;
+        }
+
+        event->kind = item.kind;
+        event->depth = this->current_depth;
+        event->name = item.name;
+        event->t = NULL_TREE;
+        event->str = NULL;
+        event->len = 0;
+        event->id = 0;
+
+        if (item.kind != VOMITORIUM_EVENT_TREE)
+        {
+            event->str = item.data;
+            event->len = item.len;
+            return true;
+        }
+
+        const_tree t = (const_tree)item.data;
+        bool is_new;
+        this->last = t;
+        event->t = CONST_CAST_TREE(t);
+        event->id = this->find_id(t, &is_new);
+        if (is_new)
+            this->pending = t;
+        else
+            event->kind = VOMITORIUM_EVENT_AGAIN;
+        return true;
+    }
+
+    assert (this->current_depth == 0);
+    event->kind = VOMITORIUM_EVENT_NONE;
+    event->depth = 0;
+    event->name = NULL;
+    event->t = NULL_TREE;
+    event->str = NULL;
+    event->len = 0;
+    event->id = 0;
+    return false;
+}
+
+inline void VomitoriumWalker::skip()
+{
+    this->pending = NULL_TREE;
+}
+
+inline void VomitoriumWalker::descend()
+{
+    this->pending = this->last;
+}
+
+inline size_t vomitorium_hash_tree(const_tree t)
+{
+    // Fibonacci hashing; trees are at least 8-byte aligned.
+    return ((uintptr_t)t >> 3) * (size_t)0x9E3779B97F4A7C15ULL;
+}
+
+// Returns the tree's id, assigning the next one if it's new.
+inline size_t VomitoriumWalker::find_id(const_tree t, bool *is_new)
+{
+    size_t mask = this->seen.size() - 1;
+    size_t i = vomitorium_hash_tree(t) & mask;
+    while (this->seen[i].t)
+    {
+        if (this->seen[i].t == t)
+        {
+            *is_new = false;
+            return this->seen[i].id;
+        }
+        i = (i + 1) & mask;
+    }
+
+    *is_new = true;
+    size_t id = ++this->seen_count;
+    this->seen[i].t = t;
+    this->seen[i].id = id;
+    if (2 * this->seen_count > this->seen.size())
+        this->grow_seen();
+    return id;
+}
+
+inline void VomitoriumWalker::grow_seen()
+{
+    std::vector<Slot> old(2 * this->seen.size());
+    old.swap(this->seen);
+    size_t mask = this->seen.size() - 1;
+    for (size_t j = 0; j < old.size(); ++j)
+    {
+        if (!old[j].t)
+            continue;
+        size_t i = vomitorium_hash_tree(old[j].t) & mask;
+        while (this->seen[i].t)
+            i = (i + 1) & mask;
+        this->seen[i] = old[j];
+    }
+}
+
+inline void VomitoriumWalker::push_tree(const char *name, const_tree t)
+{
+    if (!t)
+        return;
+    Item item = {VOMITORIUM_EVENT_TREE, name, t, 0};
+    this->stack.push_back(item);
+}
+
+inline void VomitoriumWalker::push_string(const char *name, const void *str, size_t len, size_t width)
+{
+    vomitorium_event_kind kind;
+    switch (width)
+    {
+    case 2:
+        kind = VOMITORIUM_EVENT_STRING16;
+        break;
+    case 4:
+        kind = VOMITORIUM_EVENT_STRING32;
+        break;
+    default:
+        assert (width == 1);
+        kind = VOMITORIUM_EVENT_STRING8;
+        break;
+    }
+    Item item = {kind, name, str, len};
+    this->stack.push_back(item);
+}
+
+// This only follows the fields that make up the shape of the program;
+// dump_tree() in dump-v1.cpp is the authority on *everything* in a tree.
+inline void VomitoriumWalker::push_children(const_tree orig_tree)
+{
+    tree t = CONST_CAST_TREE(orig_tree);
+    enum tree_code code = TREE_CODE(t);
+
+    Item leave = {VOMITORIUM_EVENT_NONE, NULL, NULL, 0};
+    this->stack.push_back(leave);
+    this->current_depth++;
+    size_t first = this->stack.size();
+
+#if HAS_VGCC_VERSION(4, 7)
+    if (CODE_CONTAINS_STRUCT(code, TS_TYPED))
+#else
+    if (CODE_CONTAINS_STRUCT(code, TS_COMMON))
+#endif
+        this->push_tree("type", TREE_TYPE(t));
+
+    if (code == IDENTIFIER_NODE)
+        this->push_string("name", IDENTIFIER_POINTER(t), IDENTIFIER_LENGTH(t), 1);
+
+    if (code == STRING_CST)
+    {
+        size_t width = 1;
+        tree type = TREE_TYPE(t);
+        if (type && TREE_TYPE(type))
+        {
+            HOST_WIDE_INT elt_size = int_size_in_bytes(TREE_TYPE(type));
+            if (elt_size == 2 || elt_size == 4)
+                width = elt_size;
+        }
+        this->push_string("string", TREE_STRING_POINTER(t), TREE_STRING_LENGTH(t) / width, width);
+    }
+    if (code == COMPLEX_CST)
+    {
+        this->push_tree("real", TREE_REALPART(t));
+        this->push_tree("imag", TREE_IMAGPART(t));
+    }
+    if (code == VECTOR_CST)
+    {
+#if !HAS_VGCC_VERSION(4, 8)
+        this->push_tree("elements", TREE_VECTOR_CST_ELTS(t));
+#elif !HAS_VGCC_VERSION(8, 0)
+        size_t len = VECTOR_CST_NELTS(t);
+        for (size_t i = 0; i < len; ++i)
+            this->push_tree("e", VECTOR_CST_ELT(t, i));
+#else
+        // VECTOR_CST_NELTS is a poly_uint64 now, and only the encoded
+        // elements are actually stored.
+        size_t len = vector_cst_encoded_nelts(t);
+        for (size_t i = 0; i < len; ++i)
+            this->push_tree("e", VECTOR_CST_ENCODED_ELT(t, i));
+#endif
+    }
+
+    if (code == TREE_LIST)
+    {
+        this->push_tree("purpose", TREE_PURPOSE(t));
+        this->push_tree("value", TREE_VALUE(t));
+    }
+    if (code == TREE_VEC)
+    {
+        int length = TREE_VEC_LENGTH(t);
+        for (int i = 0; i < length; ++i)
+            this->push_tree("e", TREE_VEC_ELT(t, i));
+    }
+    if (code == CONSTRUCTOR)
+    {
+        unsigned HOST_WIDE_INT ix;
+        tree index, value;
+        FOR_EACH_CONSTRUCTOR_ELT(CONSTRUCTOR_ELTS(t), ix, index, value)
+        {
+            this->push_tree("index", index);
+            this->push_tree("value", value);
+        }
+    }
+    if (code == STATEMENT_LIST)
+    {
+        for (tree_statement_list_node *node = STATEMENT_LIST_HEAD(t); node; node = node->next)
+            this->push_tree("e", node->stmt);
+    }
+
+    if (EXPR_P(t))
+    {
+        int len = TREE_OPERAND_LENGTH(t);
+        // the first operand of a CALL_EXPR is just the operand count
+        for (int i = VL_EXP_CLASS_P(t) ? 1 : 0; i < len; ++i)
+            this->push_tree("operand", TREE_OPERAND(t, i));
+    }
+
+    if (code == BLOCK)
+    {
+        this->push_tree("vars", BLOCK_VARS(t));
+        this->push_tree("subblocks", BLOCK_SUBBLOCKS(t));
+        this->push_tree("supercontext", BLOCK_SUPERCONTEXT(t));
+        this->push_tree("abstract-origin", BLOCK_ABSTRACT_ORIGIN(t));
+#if HAS_VGCC_VERSION(4, 7)
+        this->push_tree("chain", BLOCK_CHAIN(t));
+#endif
+    }
+
+    if (TYPE_P(t))
+    {
+        this->push_tree("name", TYPE_NAME(t));
+        this->push_tree("size", TYPE_SIZE(t));
+        this->push_tree("size-unit", TYPE_SIZE_UNIT(t));
+        if (code == ENUMERAL_TYPE)
+            this->push_tree("enum-values", TYPE_VALUES(t));
+        if (code == ARRAY_TYPE)
+            this->push_tree("domain", TYPE_DOMAIN(t));
+        if (RECORD_OR_UNION_TYPE_P(t))
+            this->push_tree("fields", TYPE_FIELDS(t));
+        if (code == FUNCTION_TYPE || code == METHOD_TYPE)
+            this->push_tree("arg-types", TYPE_ARG_TYPES(t));
+        if (code == INTEGER_TYPE || code == ENUMERAL_TYPE || code == BOOLEAN_TYPE || code == REAL_TYPE || code == FIXED_POINT_TYPE)
+        {
+            this->push_tree("min", TYPE_MIN_VALUE(t));
+            this->push_tree("max", TYPE_MAX_VALUE(t));
+        }
+        this->push_tree("main-variant", TYPE_MAIN_VARIANT(t));
+        this->push_tree("context", TYPE_CONTEXT(t));
+        this->push_tree("attributes", TYPE_ATTRIBUTES(t));
+    }
+
+    if (CODE_CONTAINS_STRUCT(code, TS_DECL_MINIMAL))
+    {
+        this->push_tree("name", DECL_NAME(t));
+        this->push_tree("context", DECL_CONTEXT(t));
+    }
+    if (CODE_CONTAINS_STRUCT(code, TS_DECL_COMMON))
+    {
+        this->push_tree("abstract-origin", DECL_ABSTRACT_ORIGIN(t));
+        this->push_tree("attributes", DECL_ATTRIBUTES(t));
+        this->push_tree("initial", DECL_INITIAL(t));
+        this->push_tree("size", DECL_SIZE(t));
+        this->push_tree("size-bytes", DECL_SIZE_UNIT(t));
+    }
+    if (code == FUNCTION_DECL)
+    {
+        this->push_tree("arguments", DECL_ARGUMENTS(t));
+        this->push_tree("result", DECL_RESULT(t));
+        this->push_tree("saved-tree", DECL_SAVED_TREE(t));
+    }
+
+    // Last, so that a long chain only grows the stack by one per link.
+    if (CODE_CONTAINS_STRUCT(code, TS_COMMON))
+        this->push_tree("chain", TREE_CHAIN(t));
+
+    // pushed in field order, but they need to be popped in field order
+    std::reverse(this->stack.begin() + first, this->stack.end());
+}
+
+#pragma GCC visibility pop
@@ -20,6 +20,9 @@ extern "C"
 #define VOMITORIUM_SKIP ((vomitorium_cookie)-1)
 
     extern int plugin_is_GPL_compatible;
+    // Buffered by vomitorium, so writing to this directly will not
+    // interleave properly unless you call vomitorium_sink_flush() first.
+    // Prefer the vomitorium_sink_* functions instead.
     extern FILE *vomitorium_output;
 
 
@@ -44,7 +47,6 @@ extern "C"
     };
     typedef enum vomitorium_frontend vomitorium_frontend;
 
-    // TODO: actually implement this
     struct vomitorium_visitor
     {
         // The size of this struct that *you* were compiled against.
@@ -86,6 +88,53 @@ extern "C"
     }
 
 
+
+    // ABI-visible, so explicitly assign values
+    enum vomitorium_event_kind
+    {
+        VOMITORIUM_EVENT_NONE = 0,      // the walk is finished
+        VOMITORIUM_EVENT_TREE = 1,      // a tree, reached for the first time
+        VOMITORIUM_EVENT_AGAIN = 2,     // a tree that was already reported
+        VOMITORIUM_EVENT_STRING8 = 3,
+        VOMITORIUM_EVENT_STRING16 = 4,
+        VOMITORIUM_EVENT_STRING32 = 5,
+    };
+    typedef enum vomitorium_event_kind vomitorium_event_kind;
+
+    // The pull-style equivalent of one vomitorium_visitor callback.
+    struct vomitorium_event
+    {
+        // The size of this struct that *you* were compiled against.
+        size_t _size;
+
+        vomitorium_event_kind kind;
+        // Roots are at depth 0, their children at depth 1, and so on.
+        size_t depth;
+        // Name of the field this was reached through.
+        const char *name;
+
+        // Only for VOMITORIUM_EVENT_TREE and VOMITORIUM_EVENT_AGAIN.
+        tree t;
+        // Only for VOMITORIUM_EVENT_STRING*. The length is in characters,
+        // not bytes, and the data is not necessarily NUL-terminated.
+        const void *str;
+        size_t len;
+
+        // Only for VOMITORIUM_EVENT_TREE and VOMITORIUM_EVENT_AGAIN.
+        // Numbered from 1 in the order this walk first reached them, so
+        // it's only meaningful within one walk. This is *not* the `@N`
+        // used in dumps; that's vomitorium_tree_id().
+        size_t id;
+    };
+
+    __attribute__((unused))
+    static void vomitorium_event_init(vomitorium_event *event)
+    {
+        memset(event, 0, sizeof(*event));
+        event->_size = sizeof(*event);
+    }
+
+
     extern vomitorium_frontend vomitorium_current_frontend;
     vomitorium_frontend vomitorium_calc_frontend(void);
 
@@ -93,6 +142,43 @@ extern "C"
 
     void vomitorium_visit(vomitorium_visitor *visitor, tree object);
     void vomitorium_visit_all(vomitorium_visitor *visitor);
+    // Like calling vomitorium_visit_all() once per visitor, but only walks
+    // once. Each visitor still gets its own VOMITORIUM_SKIP and cookies.
+    void vomitorium_visit_all_multi(vomitorium_visitor **visitors, size_t n);
+
+    // Write to vomitorium_output, through the same buffer that the dumps use.
+    // Either append() bytes, or reserve() at least `len` bytes, write into
+    // them, then commit() however many you actually used. The reserved
+    // pointer is only valid until the next call to any of these.
+    // Only write between dumps, not from inside visitor callbacks.
+    char *vomitorium_sink_reserve(size_t len);
+    void vomitorium_sink_commit(size_t len);
+    void vomitorium_sink_append(const char *data, size_t len);
+    void vomitorium_sink_flush(void);
+
+    // The ids used as `@N` in dumps. Id 0 is always NULL.
+    // vomitorium_tree_id() assigns a new id if the tree doesn't have one
+    // yet, which also means that later dumps will include it. Once either
+    // of these has been called, the trees are kept alive by the GC.
+    // While a GIMPLE or RTL record is being dumped, trees that don't
+    // outlive the function get ids local to that record, which mean
+    // nothing outside of it; don't look ids up from inside one.
+    size_t vomitorium_tree_id(tree t);
+    // Returns NULL for ids that haven't been assigned yet, or that were
+    // local to a record that has ended.
+    tree vomitorium_tree_by_id(size_t id);
+    size_t vomitorium_tree_count(void);
+
+    // Pull-style traversal, walking the same trees in the same order as
+    // the visitor functions above. Nothing is allocated per step, so it
+    // is fine to pull a few events at a time and stop whenever you like.
+    vomitorium_iter *vomitorium_iter_begin(tree root);
+    vomitorium_iter *vomitorium_iter_begin_all(void);
+    // Returns false (and sets VOMITORIUM_EVENT_NONE) when finished.
+    bool vomitorium_iter_next(vomitorium_iter *it, vomitorium_event *event);
+    // Don't descend into the tree from the last VOMITORIUM_EVENT_TREE.
+    void vomitorium_iter_skip(vomitorium_iter *it);
+    void vomitorium_iter_end(vomitorium_iter *it);
 
 
     int plugin_init (struct plugin_name_args *plugin_info,
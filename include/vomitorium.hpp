@@ -0,0 +1,112 @@
+#pragma once
+
+#include "vomitorium.h"
+
+#include <vector>
+
+#include "vomitorium-walk.hpp"
+
+// Optional, header-only C++ interface. vomitorium.h is still the stable ABI;
+// this is just a different way to drive it. Like vomitorium-walk.hpp, it
+// needs GCC's plugin headers, so include it after them.
+//
+// Derive from VomitoriumVisitor<YourClass> and define whichever of these
+// you care about (the rest default to doing nothing):
+//
+//     vomitorium_cookie visit_tree(const char *name, tree t);
+//     void visit_again(const char *name, vomitorium_cookie cookie);
+//     void visit_string8(const char *name, const uint8_t *str, size_t len);
+//     void visit_string16(const char *name, const uint16_t *str, size_t len);
+//     void visit_string32(const char *name, const uint32_t *str, size_t len);
+//
+// Unlike vomitorium_visitor, these are resolved at compile time, and the
+// walk itself is compiled into your plugin, so the whole traversal can be
+// inlined together with them, with no calls into vomitorium per event.
+template<class Derived>
+class VomitoriumVisitor
+{
+public:
+    vomitorium_cookie visit_tree(const char *name, tree t)
+    {
+        (void)name;
+        (void)t;
+        return NULL;
+    }
+    void visit_again(const char *name, vomitorium_cookie cookie)
+    {
+        (void)name;
+        (void)cookie;
+    }
+    void visit_string8(const char *name, const uint8_t *str, size_t len)
+    {
+        (void)name;
+        (void)str;
+        (void)len;
+    }
+    void visit_string16(const char *name, const uint16_t *str, size_t len)
+    {
+        (void)name;
+        (void)str;
+        (void)len;
+    }
+    void visit_string32(const char *name, const uint32_t *str, size_t len)
+    {
+        (void)name;
+        (void)str;
+        (void)len;
+    }
+
+    // Equivalent to vomitorium_visit() and vomitorium_visit_all().
+    void visit(tree object)
+    {
+        VomitoriumWalker walker;
+        walker.add_root("root", object);
+        this->walk(&walker);
+    }
+    void visit_all()
+    {
+        VomitoriumWalker walker;
+        walker.add_global_roots();
+        this->walk(&walker);
+    }
+private:
+    void walk(VomitoriumWalker *walker)
+    {
+        Derived *self = static_cast<Derived *>(this);
+        // indexed by vomitorium_event.id
+        std::vector<vomitorium_cookie> cookies;
+
+        vomitorium_event event;
+        vomitorium_event_init(&event);
+        while (walker->next(&event))
+        {
+            switch (event.kind)
+            {
+            case VOMITORIUM_EVENT_TREE:
+                {
+                    vomitorium_cookie cookie = self->visit_tree(event.name, event.t);
+                    if (cookie == VOMITORIUM_SKIP)
+                        walker->skip();
+                    if (event.id >= cookies.size())
+                        cookies.resize(event.id + 1);
+                    cookies[event.id] = cookie;
+                }
+                break;
+            case VOMITORIUM_EVENT_AGAIN:
+                self->visit_again(event.name, cookies[event.id]);
+                break;
+            case VOMITORIUM_EVENT_STRING8:
+                self->visit_string8(event.name, (const uint8_t *)event.str, event.len);
+                break;
+            case VOMITORIUM_EVENT_STRING16:
+                self->visit_string16(event.name, (const uint16_t *)event.str, event.len);
+                break;
+            case VOMITORIUM_EVENT_STRING32:
+                self->visit_string32(event.name, (const uint32_t *)event.str, event.len);
+                break;
+            case VOMITORIUM_EVENT_NONE:
+                break;
+            }
+        }
+    }
+};
@@ -0,0 +1,120 @@
+// Time the reader library over a (preferably huge) dump.
+// DO NOT INCLUDE ANY GCC HEADERS
+
+#include "vomitorium-reader.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "clock.hpp"
+
+
+struct Counts
+{
+    vomitorium_reader_handler handler;
+    size_t elements;
+    size_t texts;
+    size_t refs;
+};
+
+static bool count_start(vomitorium_reader_handler *self, vomitorium_string_view, vomitorium_string_view, vomitorium_string_view)
+{
+    ((Counts *)self)->elements++;
+    return true;
+}
+static bool count_text(vomitorium_reader_handler *self, vomitorium_string_view text)
+{
+    Counts *counts = (Counts *)self;
+    size_t id;
+    counts->texts++;
+    if (vomitorium_reader_tree_ref(text, &id))
+        counts->refs++;
+    return true;
+}
+
+static void counts_init(Counts *counts)
+{
+    vomitorium_reader_handler_init(&counts->handler);
+    counts->handler.start = count_start;
+    counts->handler.text = count_text;
+    counts->elements = counts->texts = counts->refs = 0;
+}
+
+static void report(const char *what, const Counts& counts, size_t bytes, uint64_t ns)
+{
+    printf("%-8s %zu elements, %zu texts, %zu refs, %.3f s, %.1f MB/s\n",
+            what, counts.elements, counts.texts, counts.refs, ns / 1e9, bytes / 1e6 / (ns / 1e9));
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3)
+    {
+        fprintf(stderr, "Usage: %s DUMP [RANDOM-LOOKUPS]\n", argv[0]);
+        return 2;
+    }
+    size_t lookups = argc == 3 ? strtoul(argv[2], nullptr, 10) : 100000;
+
+    vomitorium_reader *reader = vomitorium_reader_open(argv[1]);
+    if (!reader)
+    {
+        fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    size_t size = vomitorium_reader_data(reader).len;
+
+    Counts counts;
+    counts_init(&counts);
+    uint64_t start = monotonic_ns();
+    if (!vomitorium_reader_parse(reader, &counts.handler))
+        fprintf(stderr, "%s: parse failed\n", argv[1]);
+    report("parse", counts, size, monotonic_ns() - start);
+
+    counts_init(&counts);
+    start = monotonic_ns();
+    vomitorium_tokens *tokens = vomitorium_reader_tokens(reader);
+    vomitorium_token token;
+    vomitorium_token_init(&token);
+    while (vomitorium_tokens_next(tokens, &token))
+    {
+        if (token.kind == VOMITORIUM_TOKEN_START)
+            count_start(&counts.handler, token.tag, token.attr, token.value);
+        else if (token.kind == VOMITORIUM_TOKEN_TEXT)
+            count_text(&counts.handler, token.text);
+    }
+    vomitorium_tokens_end(tokens);
+    report("tokens", counts, size, monotonic_ns() - start);
+
+    counts_init(&counts);
+    start = monotonic_ns();
+    size_t records = vomitorium_reader_record_count(reader);
+    for (size_t i = 0; i < records; ++i)
+        vomitorium_reader_parse_record(reader, i, &counts.handler);
+    report("records", counts, size, monotonic_ns() - start);
+
+    size_t trees = vomitorium_reader_tree_count(reader);
+    if (trees)
+    {
+        counts_init(&counts);
+        // Deterministic, so that runs are comparable.
+        uint64_t x = 88172645463325252ull;
+        start = monotonic_ns();
+        for (size_t i = 0; i < lookups; ++i)
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            vomitorium_reader_parse_tree(reader, x % trees, &counts.handler);
+        }
+        uint64_t ns = monotonic_ns() - start;
+        printf("random   %zu lookups of %zu trees, %.3f s, %.0f ns/lookup\n", lookups, trees, ns / 1e9, (double)ns / lookups);
+    }
+    else
+    {
+        printf("random   skipped, no index\n");
+    }
+
+    vomitorium_reader_close(reader);
+}
@@ -0,0 +1,107 @@
+// Compare the C visitor and the C iterator (both calling into vomitorium)
+// against the header-only C++ one (which walks in this plugin), on the same
+// trees. Like demo.c, this is built as a separate plugin that links to
+// vomitorium.
+
+#include "internal.hpp"
+
+#include <ctime>
+
+#include "vomitorium.hpp"
+
+
+int plugin_is_GPL_compatible;
+
+static const int iterations = 10;
+
+static size_t c_trees;
+static size_t c_agains;
+
+static vomitorium_cookie count_visit_tree(vomitorium_visitor *, const char *, tree)
+{
+    c_trees++;
+    return nullptr;
+}
+static void count_visit_again(vomitorium_visitor *, const char *, vomitorium_cookie)
+{
+    c_agains++;
+}
+
+class CountingVisitor : public VomitoriumVisitor<CountingVisitor>
+{
+public:
+    size_t trees;
+    size_t agains;
+
+    CountingVisitor() : trees(0), agains(0) {}
+
+    vomitorium_cookie visit_tree(const char *, tree)
+    {
+        this->trees++;
+        return nullptr;
+    }
+    void visit_again(const char *, vomitorium_cookie)
+    {
+        this->agains++;
+    }
+};
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void run_bench(void *, void *)
+{
+    vomitorium_visitor visitor;
+    vomitorium_visitor_init(&visitor);
+    visitor.visit_tree = count_visit_tree;
+    visitor.visit_again = count_visit_again;
+
+    // Warm up, so that neither side pays for first touching the trees.
+    vomitorium_visit_all(&visitor);
+    c_trees = c_agains = 0;
+
+    double c_start = now_ms();
+    for (int i = 0; i < iterations; ++i)
+        vomitorium_visit_all(&visitor);
+    double c_time = (now_ms() - c_start) / iterations;
+
+    size_t iter_trees = 0;
+    size_t iter_agains = 0;
+    double iter_start = now_ms();
+    for (int i = 0; i < iterations; ++i)
+    {
+        vomitorium_iter *it = vomitorium_iter_begin_all();
+        vomitorium_event event;
+        vomitorium_event_init(&event);
+        while (vomitorium_iter_next(it, &event))
+        {
+            iter_trees += event.kind == VOMITORIUM_EVENT_TREE;
+            iter_agains += event.kind == VOMITORIUM_EVENT_AGAIN;
+        }
+        vomitorium_iter_end(it);
+    }
+    double iter_time = (now_ms() - iter_start) / iterations;
+
+    CountingVisitor cxx_visitor;
+    double cxx_start = now_ms();
+    for (int i = 0; i < iterations; ++i)
+        cxx_visitor.visit_all();
+    double cxx_time = (now_ms() - cxx_start) / iterations;
+
+    printf("C visitor:   %zu trees, %zu agains, %.3f ms/walk\n", c_trees / iterations, c_agains / iterations, c_time);
+    printf("C iterator:  %zu trees, %zu agains, %.3f ms/walk\n", iter_trees / iterations, iter_agains / iterations, iter_time);
+    printf("C++ visitor: %zu trees, %zu agains, %.3f ms/walk (%.2fx the C visitor, %.2fx the C iterator)\n", cxx_visitor.trees / iterations, cxx_visitor.agains / iterations, cxx_time, c_time / cxx_time, iter_time / cxx_time);
+}
+
+int plugin_init (struct plugin_name_args *plugin_info,
+                 struct plugin_gcc_version *version)
+{
+    (void)version;
+
+    register_callback(plugin_info->base_name, PLUGIN_FINISH_UNIT, run_bench, nullptr);
+    return 0;
+}
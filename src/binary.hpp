@@ -0,0 +1,261 @@
+#pragma once
+
+// DO NOT INCLUDE ANY GCC HEADERS
+// (this is shared by the converter and anything that reads its output)
+
+/*
+    The compact binary dump format.
+
+    The same tree of elements as the v1 XML, as a stream of ops:
+
+        BinaryHeader
+        blocks, each:
+            OP_BLOCK            forget all names
+            OP_NAME len bytes   define the next name id, starting at 0;
+                                all of a block's names come first
+            then any of:
+            OP_START name attr [value]
+                                attr is 0 for none, or a name id + 1
+            OP_TEXT value
+            OP_END
+        tree table: tree_count pairs of little-endian uint64: the offset
+                    of the block and of the OP_START of <tree id="@N">
+                    in a <vomitorium-dump> record, or all ones if there
+                    is no such tree (GIMPLE and RTL records aren't in
+                    the table, since some of their @N are local to them)
+        BinaryFooter
+
+    Numbers are unsigned LEB128. A value is a number `x`, then: if `x` is
+    odd, it's the reference @(x >> 1); if even, (x >> 1) bytes of
+    unescaped text follow. Blocks are independent, so they can be written
+    and read in parallel; elements may span blocks.
+*/
+#include <cstdint>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#define BINARY_MAGIC "VOMBIN\0\0"
+#define BINARY_FOOTER_MAGIC "VOMBINIX"
+#define BINARY_VERSION 1
+#define BINARY_TREE_ABSENT UINT64_MAX
+
+enum BinaryOp
+{
+    OP_BLOCK = 1,
+    OP_NAME = 2,
+    OP_START = 3,
+    OP_TEXT = 4,
+    OP_END = 5,
+};
+
+struct BinaryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t _pad;
+};
+
+struct BinaryFooter
+{
+    uint64_t tree_table_offset;
+    uint64_t tree_count;
+    char magic[8];
+};
+
+
+inline void put_leb128(std::string *out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out->push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out->push_back((char)v);
+}
+
+inline bool get_leb128(const uint8_t **p, const uint8_t *end, uint64_t *out)
+{
+    uint64_t v = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7)
+    {
+        uint8_t b = *(*p)++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+        {
+            *out = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void put_le64(std::string *out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        out->push_back((char)(v >> (8 * i)));
+}
+
+inline uint64_t get_le64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+
+// One event, as decoded. Strings point into the input.
+struct BinaryEvent
+{
+    BinaryOp op;            // OP_START, OP_TEXT or OP_END only
+    const char *name;
+    size_t name_len;
+    const char *attr;       // NULL if there is no attribute
+    size_t attr_len;
+    bool is_ref;
+    uint64_t ref;
+    const char *str;
+    size_t str_len;
+};
+
+class BinaryDecoder
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    struct Name
+    {
+        const char *data;
+        size_t len;
+    };
+    std::vector<Name> names;
+    bool error;
+public:
+    BinaryDecoder(const uint8_t *begin, const uint8_t *e)
+    : p(begin)
+    , end(e)
+    , error(false)
+    {
+    }
+
+    // For random access: read the names of the block starting at `block`,
+    // then continue from `at`, somewhere later in the same block.
+    bool seek(const uint8_t *block, const uint8_t *at)
+    {
+        this->p = block;
+        if (this->p == this->end || *this->p++ != OP_BLOCK)
+            return this->fail();
+        this->names.clear();
+        while (this->p < this->end && *this->p == OP_NAME)
+        {
+            ++this->p;
+            if (!this->name())
+                return false;
+        }
+        if (at < this->p || at > this->end)
+            return this->fail();
+        this->p = at;
+        return true;
+    }
+
+    // Returns false at the end, or at the first error.
+    bool next(BinaryEvent *event)
+    {
+        while (this->p < this->end)
+        {
+            BinaryOp op = (BinaryOp)*this->p++;
+            uint64_t n;
+            switch (op)
+            {
+            case OP_BLOCK:
+                this->names.clear();
+                continue;
+            case OP_NAME:
+                if (!this->name())
+                    return false;
+                continue;
+            case OP_START:
+                event->op = op;
+                if (!get_leb128(&this->p, this->end, &n) || n >= this->names.size())
+                    return this->fail();
+                event->name = this->names[n].data;
+                event->name_len = this->names[n].len;
+                if (!get_leb128(&this->p, this->end, &n) || n > this->names.size())
+                    return this->fail();
+                event->attr = nullptr;
+                event->attr_len = 0;
+                event->is_ref = false;
+                event->str = nullptr;
+                event->str_len = 0;
+                if (!n)
+                    return true;
+                event->attr = this->names[n - 1].data;
+                event->attr_len = this->names[n - 1].len;
+                return this->value(event);
+            case OP_TEXT:
+                event->op = op;
+                event->name = nullptr;
+                event->name_len = 0;
+                event->attr = nullptr;
+                event->attr_len = 0;
+                return this->value(event);
+            case OP_END:
+                event->op = op;
+                return true;
+            }
+            return this->fail();
+        }
+        return false;
+    }
+
+    bool failed() const
+    {
+        return this->error;
+    }
+
+    size_t offset_from(const uint8_t *begin) const
+    {
+        return this->p - begin;
+    }
+private:
+    bool fail()
+    {
+        this->error = true;
+        return false;
+    }
+
+    bool name()
+    {
+        uint64_t n;
+        if (!get_leb128(&this->p, this->end, &n) || n > (uint64_t)(this->end - this->p))
+            return this->fail();
+        Name name = {(const char *)this->p, (size_t)n};
+        this->names.push_back(name);
+        this->p += n;
+        return true;
+    }
+
+    bool value(BinaryEvent *event)
+    {
+        uint64_t x;
+        if (!get_leb128(&this->p, this->end, &x))
+            return this->fail();
+        event->is_ref = x & 1;
+        event->ref = 0;
+        event->str = nullptr;
+        event->str_len = 0;
+        if (event->is_ref)
+        {
+            event->ref = x >> 1;
+            return true;
+        }
+        x >>= 1;
+        if (x > (uint64_t)(this->end - this->p))
+            return this->fail();
+        event->str = (const char *)this->p;
+        event->str_len = x;
+        this->p += x;
+        return true;
+    }
+};
@@ -0,0 +1,231 @@
+#include "buffer.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "compress.hpp"
+
+
+// Both how much of the file to map at once, and how far to grow it.
+#define MAP_EXTENT ((size_t)64 << 20)
+
+
+OutputBuffer::OutputBuffer(FILE *out, bool close, size_t cap)
+: output_file(out)
+, should_close(close)
+, data(nullptr)
+, used(0)
+, capacity(cap)
+, flushed(0)
+, compressor(nullptr)
+, frames_file(nullptr)
+, compressed_written(0)
+, map_fd(-1)
+, allocated(0)
+{
+    if (!out)
+        abort();
+    this->data = (char *)malloc(this->capacity);
+    if (!this->data)
+        abort();
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    this->flush();
+    if (this->map_fd == -1)
+        free(this->data);
+    else
+    {
+        if (this->data)
+            munmap(this->data, this->capacity);
+        close(this->map_fd);
+    }
+    delete this->compressor;
+    if (this->frames_file)
+        fclose(this->frames_file);
+    if (this->should_close)
+        fclose(this->output_file);
+}
+
+char *OutputBuffer::reserve(size_t n)
+{
+    if (this->map_fd != -1)
+    {
+        if (this->capacity - this->used < n)
+            this->map_window(n);
+        // A flush() may have cut the file short of the window.
+        if (this->tell() + n > this->allocated)
+            this->allocate(this->flushed + this->capacity);
+        return this->data + this->used;
+    }
+    if (this->capacity - this->used < n)
+    {
+        this->flush();
+        if (this->capacity < n)
+        {
+            free(this->data);
+            this->capacity = n;
+            this->data = (char *)malloc(this->capacity);
+            if (!this->data)
+                abort();
+        }
+    }
+    return this->data + this->used;
+}
+
+void OutputBuffer::commit(size_t n)
+{
+    assert (n <= this->capacity - this->used);
+    this->used += n;
+}
+
+void OutputBuffer::append(const char *s, size_t n)
+{
+    // Don't bother copying things that won't fit anyway.
+    if (n >= this->capacity && this->map_fd == -1)
+    {
+        this->flush();
+        this->write_out(s, n);
+        this->flushed += n;
+        return;
+    }
+    memcpy(this->reserve(n), s, n);
+    this->commit(n);
+}
+
+void OutputBuffer::flush()
+{
+    if (this->map_fd != -1)
+    {
+        // It's all in the file already, apart from the preallocated tail.
+        size_t end = this->tell();
+        if (this->allocated != end)
+        {
+            if (ftruncate(this->map_fd, end) == -1)
+                abort();
+            this->allocated = end;
+        }
+        return;
+    }
+    if (this->used)
+        this->write_out(this->data, this->used);
+    this->flushed += this->used;
+    this->used = 0;
+    fflush(this->output_file);
+}
+
+// Write `n` bytes that start at uncompressed offset `this->flushed`.
+void OutputBuffer::write_out(const char *s, size_t n)
+{
+    if (this->compressor)
+    {
+        this->compressor->frame(s, n, &this->compressed);
+        if (this->frames_file)
+            fprintf(this->frames_file, FRAME_FORMAT, this->flushed, this->compressed_written);
+        s = this->compressed.data();
+        n = this->compressed.size();
+        this->compressed_written += n;
+    }
+    while (n)
+    {
+        size_t rv = fwrite(s, 1, n, this->output_file);
+        if (rv == 0)
+            abort();
+        s += rv;
+        n -= rv;
+    }
+}
+
+size_t OutputBuffer::tell() const
+{
+    return this->flushed + this->used;
+}
+
+void OutputBuffer::compress(Compressor *c, FILE *frames)
+{
+    // Frames of what was already written can't be made after the fact.
+    assert (!this->flushed);
+    assert (this->map_fd == -1);
+    this->compressor = c;
+    this->frames_file = frames;
+}
+
+bool OutputBuffer::map_file()
+{
+    if (this->compressor || this->tell())
+        return false;
+    int fd = fileno(this->output_file);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return false;
+    // The mapping has to start at the beginning of the file, but stdout
+    // might have been opened for appending.
+    if (lseek(fd, 0, SEEK_CUR) != 0)
+        return false;
+
+    // A shared mapping needs to read as well as write, which the FILE
+    // (or a shell redirect) usually can't. It's still the same file.
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    int rw = open(path, O_RDWR | O_CLOEXEC);
+    if (rw == -1)
+        return false;
+
+    free(this->data);
+    this->data = nullptr;
+    this->capacity = 0;
+    this->map_fd = rw;
+    this->allocated = st.st_size;
+    return true;
+}
+
+// Move the window so that it starts at the page holding tell(), and has
+// at least `n` bytes after it.
+void OutputBuffer::map_window(size_t n)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t pos = this->tell();
+    size_t start = pos - pos % page;
+    size_t size = pos - start + n;
+    if (size < MAP_EXTENT)
+        size = MAP_EXTENT;
+
+    if (this->data)
+        munmap(this->data, this->capacity);
+    this->data = nullptr;
+    // Writing to a page past the end of the file is SIGBUS.
+    this->allocate(start + size);
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->map_fd, start);
+    if (map == MAP_FAILED)
+        abort();
+    this->data = (char *)map;
+    this->capacity = size;
+    this->flushed = start;
+    this->used = pos - start;
+}
+
+// Make the file at least `end` bytes long, in one extent if possible.
+void OutputBuffer::allocate(size_t end)
+{
+    if (end <= this->allocated)
+        return;
+    size_t grow = end - this->allocated;
+    if (grow < MAP_EXTENT)
+        grow = MAP_EXTENT;
+    // Not posix_fallocate(), which would write zeros where fallocate()
+    // isn't supported. Just leave a hole there instead.
+    if (fallocate(this->map_fd, 0, this->allocated, grow) == -1)
+    {
+        if (errno != EOPNOTSUPP || ftruncate(this->map_fd, this->allocated + grow) == -1)
+            abort();
+    }
+    this->allocated += grow;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+    A large write buffer in front of a FILE.
+
+    Everything that goes to the same file should go through the same
+    OutputBuffer, so that it comes out in the order it was written.
+    Callers may either append() bytes, or reserve() space, format directly
+    into it, and commit() however much of it they actually used.
+
+    Offsets (from tell()) are always of the uncompressed data, even if
+    compress() has been called; see compress.hpp.
+
+    Alternatively, after map_file(), there is no separate buffer at all:
+    reserve() hands out space in a shared mapping of the file itself, which
+    grows 64 MiB at a time (preallocated with fallocate, so it's
+    contiguous and can't run out halfway through a window). flush() then
+    only has to cut the file back to tell().
+*/
+#include <cstddef>
+#include <cstdio>
+
+#include <vector>
+
+class Compressor;
+
+class OutputBuffer
+{
+    FILE *output_file;
+    bool should_close;
+
+    char *data;
+    size_t used;
+    size_t capacity;
+    size_t flushed;
+
+    Compressor *compressor;
+    FILE *frames_file;
+    size_t compressed_written;
+    std::vector<char> compressed;
+
+    // -1 unless map_file() succeeded; then it's our own read-write fd for
+    // the file, `data` is a window of it starting at offset `flushed`, and
+    // the file is `allocated` long.
+    int map_fd;
+    size_t allocated;
+
+    void write_out(const char *s, size_t n);
+    void map_window(size_t n);
+    void allocate(size_t end);
+public:
+    OutputBuffer(FILE *out, bool should_close, size_t capacity=1024*1024);
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator = (const OutputBuffer&) = delete;
+    ~OutputBuffer();
+
+    // The returned pointer is only valid until the next call.
+    char *reserve(size_t n);
+    void commit(size_t n);
+    void append(const char *s, size_t n);
+    // Write everything buffered so far all the way to the file.
+    void flush();
+    // How many bytes have been written, counting ones still buffered.
+    size_t tell() const;
+    // Compress everything from now on, one frame per flush. Takes
+    // ownership of both; `frames` may be NULL.
+    void compress(Compressor *c, FILE *frames);
+    // Write by mmapping the file instead, if it is a regular file and
+    // nothing has been written or compressed yet. Otherwise, nothing
+    // changes and this returns false.
+    bool map_file();
+};
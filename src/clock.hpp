@@ -0,0 +1,15 @@
+#pragma once
+
+// DO NOT INCLUDE ANY GCC HEADERS
+
+#include <cstdint>
+#include <ctime>
+
+
+// Nanoseconds since some arbitrary point; only differences are meaningful.
+inline uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
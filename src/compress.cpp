@@ -0,0 +1,121 @@
+#include "compress.hpp"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef VOMITORIUM_HAVE_ZLIB
+# include <zlib.h>
+#endif
+#ifdef VOMITORIUM_HAVE_ZSTD
+# include <zstd.h>
+#endif
+
+#include "compat.hpp"
+
+
+Compressor::~Compressor()
+{
+}
+
+#ifdef VOMITORIUM_HAVE_ZLIB
+class GzipCompressor : public Compressor
+{
+    z_stream stream;
+public:
+    GzipCompressor(int level)
+    {
+        memset(&this->stream, 0, sizeof(this->stream));
+        // 16 more window bits means a gzip header, not a zlib one.
+        if (deflateInit2(&this->stream, level ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            abort();
+    }
+    ~GzipCompressor()
+    {
+        deflateEnd(&this->stream);
+    }
+
+    virtual void frame(const char *data, size_t n, std::vector<char> *out) override
+    {
+        if (deflateReset(&this->stream) != Z_OK)
+            abort();
+        out->resize(deflateBound(&this->stream, n));
+        this->stream.next_in = (Bytef *)data;
+        this->stream.next_out = (Bytef *)&(*out)[0];
+        size_t in_left = n;
+        size_t out_left = out->size();
+        int ret;
+        // zlib counts in uInt, so hand it at most UINT_MAX bytes at a time.
+        do
+        {
+            uInt in_chunk = in_left < UINT_MAX ? in_left : UINT_MAX;
+            uInt out_chunk = out_left < UINT_MAX ? out_left : UINT_MAX;
+            this->stream.avail_in = in_chunk;
+            this->stream.avail_out = out_chunk;
+            ret = deflate(&this->stream, in_left == in_chunk ? Z_FINISH : Z_NO_FLUSH);
+            in_left -= in_chunk - this->stream.avail_in;
+            out_left -= out_chunk - this->stream.avail_out;
+        }
+        while (ret == Z_OK);
+        if (ret != Z_STREAM_END)
+            abort();
+        out->resize(out->size() - out_left);
+    }
+};
+#endif
+
+#ifdef VOMITORIUM_HAVE_ZSTD
+class ZstdCompressor : public Compressor
+{
+    ZSTD_CCtx *context;
+    int level;
+public:
+    ZstdCompressor(int l) : context(ZSTD_createCCtx()), level(l)
+    {
+        if (!this->context)
+            abort();
+    }
+    ~ZstdCompressor()
+    {
+        ZSTD_freeCCtx(this->context);
+    }
+
+    virtual void frame(const char *data, size_t n, std::vector<char> *out) override
+    {
+        out->resize(ZSTD_compressBound(n));
+        size_t len = ZSTD_compressCCtx(this->context, &(*out)[0], out->size(), data, n, this->level);
+        if (ZSTD_isError(len))
+            abort();
+        out->resize(len);
+    }
+};
+#endif
+
+Compressor *make_compressor(const char *name, int level)
+{
+#ifdef VOMITORIUM_HAVE_ZLIB
+    if (strcmp(name, "gzip") == 0)
+        return new GzipCompressor(level);
+#endif
+#ifdef VOMITORIUM_HAVE_ZSTD
+    if (strcmp(name, "zstd") == 0)
+        return new ZstdCompressor(level);
+#endif
+    (void)name;
+    (void)level;
+    return nullptr;
+}
+
+int max_compress_level(const char *name)
+{
+#ifdef VOMITORIUM_HAVE_ZLIB
+    if (strcmp(name, "gzip") == 0)
+        return Z_BEST_COMPRESSION;
+#endif
+#ifdef VOMITORIUM_HAVE_ZSTD
+    if (strcmp(name, "zstd") == 0)
+        return ZSTD_maxCLevel();
+#endif
+    (void)name;
+    return 0;
+}
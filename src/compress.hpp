@@ -0,0 +1,41 @@
+#pragma once
+
+// DO NOT INCLUDE ANY GCC HEADERS
+
+/*
+    Optional compression for an OutputBuffer.
+
+    Every flush becomes one independent frame (a gzip member or a zstd
+    frame), so the output is still an ordinary .gz or .zst file, but any
+    frame can also be decompressed on its own. For that, the buffer can
+    write a line per frame to a separate file:
+
+        UNCOMPRESSED-OFFSET COMPRESSED-OFFSET
+
+    To read from uncompressed offset N (from the index, say), start at the
+    last frame whose uncompressed offset is <= N, decompress from its
+    compressed offset on, and skip the first N - UNCOMPRESSED-OFFSET bytes.
+    vomitorium-reader doesn't do this for you: it only reads uncompressed
+    dumps, so random access into a compressed one is by hand (see the
+    test-dump-compress target for an example with gzip).
+*/
+#include <cstddef>
+
+#include <vector>
+
+#define FRAME_FORMAT "%016zx %016zx\n"
+
+class Compressor
+{
+public:
+    virtual ~Compressor();
+    // Replace `out` with a complete frame holding `n` bytes from `data`.
+    virtual void frame(const char *data, size_t n, std::vector<char> *out) = 0;
+};
+
+// Returns nullptr if `name` is not "gzip" or "zstd", or if we weren't
+// built with it. `level` 0 means the library's default.
+Compressor *make_compressor(const char *name, int level);
+// The highest `level` that make_compressor() accepts for `name`,
+// or 0 if it can't make that compressor at all.
+int max_compress_level(const char *name);
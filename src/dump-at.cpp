@@ -0,0 +1,88 @@
+#include "internal.hpp"
+
+#include <cstring>
+
+#include "vgcc/tree-pass.h"
+#include "vgcc/tree.h"
+
+
+// Where the dumpers hook in, as given by -fplugin-arg-vomitorium-dump-at=
+//
+//     pre-genericize   once per function body, before it's lowered (default)
+//     finish-unit      once per translation unit, after everything
+//     finish-decl      after every declaration (GCC 4.7 and later)
+//     finish-type      after every type
+//     anything else    after every execution of the GCC pass with that name
+//
+// finish-unit comes after the whole unit has been compiled, so function
+// bodies have already been lowered and thrown away: it has every decl,
+// but no DECL_SAVED_TREE. Use pre-genericize for bodies.
+//
+// For finish-decl and finish-type, the dumper is also given the new decl
+// or type, since it usually isn't reachable from the globals yet.
+
+struct DumpAt
+{
+    DumpFunction fn;
+    const char *pass;
+    size_t hits;
+};
+
+static void dump_at_event(void *, void *user_data)
+{
+    DumpAt *at = (DumpAt *)user_data;
+    at->fn(NULL_TREE);
+}
+
+static void dump_at_tree(void *gcc_data, void *user_data)
+{
+    DumpAt *at = (DumpAt *)user_data;
+    at->fn((tree)gcc_data);
+}
+
+static void dump_at_pass(void *gcc_data, void *user_data)
+{
+    DumpAt *at = (DumpAt *)user_data;
+    const opt_pass *pass = (const opt_pass *)gcc_data;
+    if (!pass->name || strcmp(pass->name, at->pass) != 0)
+        return;
+    at->hits++;
+    at->fn(NULL_TREE);
+}
+
+static void dump_at_check_pass(void *, void *user_data)
+{
+    DumpAt *at = (DumpAt *)user_data;
+    if (!at->hits)
+        fprintf(stderr, "Warning: vomitorium dump-at pass '%s' never ran\n", at->pass);
+}
+
+void register_dump(const char *dump_at, DumpFunction fn)
+{
+    // Lives as long as the plugin does.
+    DumpAt *at = new DumpAt;
+    at->fn = fn;
+    at->pass = nullptr;
+    at->hits = 0;
+
+    if (!dump_at || strcmp(dump_at, "pre-genericize") == 0)
+        register_callback("vomitorium", PLUGIN_PRE_GENERICIZE, dump_at_event, at);
+    else if (strcmp(dump_at, "finish-unit") == 0)
+        register_callback("vomitorium", PLUGIN_FINISH_UNIT, dump_at_event, at);
+    else if (strcmp(dump_at, "finish-decl") == 0)
+    {
+#if V(4, 7)
+        register_callback("vomitorium", PLUGIN_FINISH_DECL, dump_at_tree, at);
+#else
+        fprintf(stderr, "Warning: vomitorium dump-at=finish-decl needs PLUGIN_FINISH_DECL (GCC 4.7)\n");
+#endif
+    }
+    else if (strcmp(dump_at, "finish-type") == 0)
+        register_callback("vomitorium", PLUGIN_FINISH_TYPE, dump_at_tree, at);
+    else
+    {
+        at->pass = dump_at;
+        register_callback("vomitorium", PLUGIN_PASS_EXECUTION, dump_at_pass, at);
+        register_callback("vomitorium", PLUGIN_FINISH, dump_at_check_pass, at);
+    }
+}
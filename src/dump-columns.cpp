@@ -0,0 +1,612 @@
+// Export the trees of v1 XML dumps as columns, grouped by tree code.
+// DO NOT INCLUDE ANY GCC HEADERS
+//
+//     DIR/strings              the dictionary: u32 length, then the bytes
+//     DIR/columns.tsv          code, field, kind, rows, values; one per line
+//     DIR/CODE/ids             u64 tree id per row
+//     DIR/CODE/FIELD.bits      flags: a bit per row, least significant first
+//     DIR/CODE/FIELD.refs      u64 tree id per value, or all ones if absent
+//     DIR/CODE/FIELD.strings   u32 index into DIR/strings per value,
+//                              or all ones if absent
+//     DIR/CODE/FIELD.u32       u32 per value, or all ones if absent
+//     DIR/CODE/FIELD.offsets   only if FIELD repeats within a tree, like the
+//                              <e> of a TREE_VEC: u64 per row, plus one;
+//                              row i has values [offsets[i], offsets[i + 1])
+//
+// All numbers are little-endian. Nested fields are joined with '.', and
+// attributes of fields are dropped. A field that is sometimes a reference
+// and sometimes not is exported as strings, with references as "@N" and
+// flags as "".
+//
+// A location (`<location>`, or the `<start>`/`<finish>` of a range) is
+// split into FIELD.file (strings), FIELD.line and FIELD.column (u32),
+// and a FIELD.system flag for system headers; `:+N:C` deltas are
+// resolved against the previous location in the file.
+//
+// With a string table, `$N` names and files are replaced with the
+// record's <string id="$N">, since N only means anything in its record.
+// Only the <tree>s of <vomitorium-dump> records are exported; GIMPLE and
+// RTL records also have function-local ones, whose ids mean nothing
+// outside the record. Anything else (globals, statements, insns) is
+// ignored.
+
+#include "vomitorium-reader.h"
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "binary.hpp"
+#include "compat.hpp"
+
+
+#define ABSENT_STRING UINT32_MAX
+#define ABSENT_U32 UINT32_MAX
+
+enum FieldKind
+{
+    FIELD_FLAG,
+    FIELD_REF,
+    FIELD_STRING,
+    FIELD_U32,
+};
+
+struct Column
+{
+    bool any[4];
+    // Per row, how many values it has.
+    std::vector<uint32_t> counts;
+    // For each value: a tree id, a dictionary index, or nothing.
+    std::vector<uint64_t> values;
+    std::vector<FieldKind> kinds;
+
+    Column()
+    {
+        this->any[FIELD_FLAG] = this->any[FIELD_REF] = this->any[FIELD_STRING] = this->any[FIELD_U32] = false;
+    }
+
+    bool only(FieldKind kind) const
+    {
+        return this->any[kind] && this->any[FIELD_FLAG] + this->any[FIELD_REF] + this->any[FIELD_STRING] + this->any[FIELD_U32] == 1;
+    }
+
+    // Whether any row has more than one value.
+    bool repeats() const
+    {
+        for (size_t i = 0; i < this->counts.size(); ++i)
+            if (this->counts[i] > 1)
+                return true;
+        return false;
+    }
+};
+
+struct Table
+{
+    std::vector<uint64_t> ids;
+    // Sorted, so the manifest is too.
+    std::map<std::string, Column> columns;
+};
+
+// One field of the tree being read, until we know its code.
+struct Field
+{
+    std::string path;
+    FieldKind kind;
+    uint64_t value;
+    // A `$N` string, to be looked up once the record has defined it.
+    std::string string_ref;
+};
+
+// A value that is still a `$N` string.
+struct StringRefUse
+{
+    Column *column;
+    size_t value;
+    std::string ref;
+};
+
+struct Location
+{
+    std::string file;
+    bool system;
+    uint32_t line;
+    uint32_t column;
+};
+
+struct Exporter
+{
+    std::map<std::string, Table> tables;
+    std::unordered_map<std::string, uint32_t> string_ids;
+    std::vector<std::string> strings;
+
+    // Within the current record.
+    std::unordered_map<std::string, std::string> record_strings;
+    std::vector<StringRefUse> string_ref_uses;
+};
+
+
+static void die(const char *path, const char *what)
+{
+    fprintf(stderr, "%s: %s\n", path, what);
+    exit(1);
+}
+
+static bool view_is(vomitorium_string_view v, const char *s)
+{
+    return v.len == strlen(s) && memcmp(v.data, s, v.len) == 0;
+}
+
+static uint32_t intern_string(Exporter *exp, const std::string& s)
+{
+    auto it = exp->string_ids.find(s);
+    if (it != exp->string_ids.end())
+        return it->second;
+    uint32_t id = exp->strings.size();
+    exp->string_ids[s] = id;
+    exp->strings.push_back(s);
+    return id;
+}
+
+static bool is_string_ref(const std::string& s)
+{
+    if (s.size() < 2 || s[0] != '$')
+        return false;
+    for (size_t i = 1; i < s.size(); ++i)
+        if (s[i] < '0' || s[i] > '9')
+            return false;
+    return true;
+}
+
+static void set_string(Exporter *exp, Field *field, const std::string& s)
+{
+    field->kind = FIELD_STRING;
+    if (is_string_ref(s))
+    {
+        field->value = ABSENT_STRING;
+        field->string_ref = s;
+    }
+    else
+        field->value = intern_string(exp, s);
+}
+
+// At the end of a record, since a <string> comes after its first use.
+// Without a definition (no string table), `$N` was just a name.
+static void resolve_string_refs(Exporter *exp)
+{
+    for (size_t i = 0; i < exp->string_ref_uses.size(); ++i)
+    {
+        const StringRefUse& use = exp->string_ref_uses[i];
+        auto it = exp->record_strings.find(use.ref);
+        use.column->values[use.value] = intern_string(exp, it != exp->record_strings.end() ? it->second : use.ref);
+    }
+    exp->string_ref_uses.clear();
+    exp->record_strings.clear();
+}
+
+static bool parse_int(const char *begin, const char *end, long *out)
+{
+    char *stop;
+    errno = 0;
+    long v = strtol(begin, &stop, 10);
+    if (stop != end || stop == begin || errno || v < INT32_MIN || v > (long)UINT32_MAX)
+        return false;
+    *out = v;
+    return true;
+}
+
+// `"FILE":LINE:COLUMN`, `<FILE>:LINE:COLUMN`, or relative to `last`,
+// `:+LINES:COLUMN` / `:-LINES:COLUMN`.
+static bool parse_location(const std::string& s, const Location *last, Location *loc)
+{
+    size_t column_colon = s.rfind(':');
+    if (column_colon == std::string::npos || column_colon == 0)
+        return false;
+    size_t line_colon = s.rfind(':', column_colon - 1);
+    if (line_colon == std::string::npos)
+        return false;
+    long line, column;
+    if (!parse_int(&s[line_colon + 1], &s[column_colon], &line)
+            || !parse_int(&s[column_colon + 1], &s[0] + s.size(), &column)
+            || column < 0)
+        return false;
+    if (line_colon == 0)
+    {
+        if (!last)
+            return false;
+        loc->file = last->file;
+        loc->system = last->system;
+        line += last->line;
+    }
+    else
+    {
+        char open = s[0], close = s[line_colon - 1];
+        if (line_colon < 2 || !((open == '"' && close == '"') || (open == '<' && close == '>')))
+            return false;
+        loc->file = s.substr(1, line_colon - 2);
+        loc->system = open == '<';
+    }
+    if (line < 0)
+        return false;
+    loc->line = line;
+    loc->column = column;
+    return true;
+}
+
+static void add_location(Exporter *exp, std::vector<Field> *fields, const std::string& path, const Location& loc)
+{
+    Field field;
+    field.path = path + ".file";
+    set_string(exp, &field, loc.file);
+    fields->push_back(field);
+    field.string_ref.clear();
+    field.path = path + ".line";
+    field.kind = FIELD_U32;
+    field.value = loc.line;
+    fields->push_back(field);
+    field.path = path + ".column";
+    field.value = loc.column;
+    fields->push_back(field);
+    if (loc.system)
+    {
+        field.path = path + ".system";
+        field.kind = FIELD_FLAG;
+        field.value = 0;
+        fields->push_back(field);
+    }
+}
+
+static void add_row(Exporter *exp, const std::string& code, uint64_t id, const std::vector<Field>& fields)
+{
+    Table& table = exp->tables[code];
+    size_t row = table.ids.size();
+    table.ids.push_back(id);
+    for (size_t i = 0; i < fields.size(); ++i)
+    {
+        const Field& field = fields[i];
+        Column& col = table.columns[field.path];
+        col.counts.resize(row + 1, 0);
+        col.counts[row]++;
+        if (!field.string_ref.empty())
+        {
+            StringRefUse use = {&col, col.values.size(), field.string_ref};
+            exp->string_ref_uses.push_back(use);
+        }
+        col.values.push_back(field.value);
+        col.kinds.push_back(field.kind);
+        col.any[field.kind] = true;
+    }
+}
+
+// Collect every <tree> of the file's <vomitorium-dump> records, as rows.
+static bool read_trees(Exporter *exp, vomitorium_reader *reader)
+{
+    vomitorium_tokens *tokens = vomitorium_reader_tokens(reader);
+    vomitorium_token token;
+    vomitorium_token_init(&token);
+
+    bool in_dump = false;
+    // Within a <tree>: the depth of the <tree>, the path to here, and
+    // whether the innermost open field has had any text or children.
+    bool in_tree = false;
+    size_t tree_depth = 0;
+    uint64_t tree_id = 0;
+    std::string code;
+    std::vector<Field> fields;
+    std::vector<size_t> path_lengths;
+    std::string path;
+    std::vector<bool> has_content;
+    std::vector<char> scratch;
+    // Deltas are against the previous location anywhere in the stream,
+    // not just in trees.
+    Location last_location;
+    bool have_last_location = false;
+    // Text is only ever the whole content of the innermost element.
+    vomitorium_string_view text_tag = {nullptr, 0};
+    // The id of the <string> being read, if any.
+    std::string string_def;
+
+    while (vomitorium_tokens_next(tokens, &token))
+    {
+        switch (token.kind)
+        {
+        case VOMITORIUM_TOKEN_START:
+            text_tag = token.tag;
+            if (token.depth == 0)
+                in_dump = view_is(token.tag, "vomitorium-dump");
+            if (!in_tree)
+            {
+                if (view_is(token.tag, "string") && view_is(token.attr, "id"))
+                {
+                    // An empty string has no text token.
+                    string_def.assign(token.value.data, token.value.len);
+                    exp->record_strings[string_def].clear();
+                    break;
+                }
+                size_t id;
+                if (in_dump && view_is(token.tag, "tree") && view_is(token.attr, "id") && vomitorium_reader_tree_ref(token.value, &id))
+                {
+                    in_tree = true;
+                    tree_depth = token.depth;
+                    tree_id = id;
+                    code.clear();
+                    fields.clear();
+                    path.clear();
+                    path_lengths.clear();
+                    has_content.clear();
+                }
+                break;
+            }
+            if (!has_content.empty())
+                has_content.back() = true;
+            path_lengths.push_back(path.size());
+            if (!path.empty())
+                path += '.';
+            path.append(token.tag.data, token.tag.len);
+            has_content.push_back(false);
+            break;
+        case VOMITORIUM_TOKEN_TEXT:
+            if (view_is(text_tag, "location") || view_is(text_tag, "start") || view_is(text_tag, "finish"))
+            {
+                scratch.resize(token.text.len + 1);
+                size_t len = vomitorium_reader_unescape(token.text, &scratch[0]);
+                Location loc;
+                if (parse_location(std::string(&scratch[0], len), have_last_location ? &last_location : nullptr, &loc))
+                {
+                    last_location = loc;
+                    have_last_location = true;
+                    if (in_tree && !has_content.empty())
+                    {
+                        has_content.back() = true;
+                        add_location(exp, &fields, path, loc);
+                    }
+                    break;
+                }
+            }
+            if (!in_tree && view_is(text_tag, "string") && !string_def.empty())
+            {
+                scratch.resize(token.text.len + 1);
+                size_t len = vomitorium_reader_unescape(token.text, &scratch[0]);
+                exp->record_strings[string_def].assign(&scratch[0], len);
+                break;
+            }
+            if (!in_tree || has_content.empty())
+                break;
+            has_content.back() = true;
+            if (path == "code")
+            {
+                code.assign(token.text.data, token.text.len);
+                break;
+            }
+            {
+                Field field;
+                field.path = path;
+                size_t id;
+                if (vomitorium_reader_tree_ref(token.text, &id))
+                {
+                    field.kind = FIELD_REF;
+                    field.value = id;
+                }
+                else
+                {
+                    scratch.resize(token.text.len + 1);
+                    size_t len = vomitorium_reader_unescape(token.text, &scratch[0]);
+                    set_string(exp, &field, std::string(&scratch[0], len));
+                }
+                fields.push_back(field);
+            }
+            break;
+        case VOMITORIUM_TOKEN_END:
+            if (!in_tree)
+            {
+                string_def.clear();
+                if (token.depth == 0)
+                    resolve_string_refs(exp);
+                break;
+            }
+            if (token.depth == tree_depth)
+            {
+                // NULL_TREE has no code, and nothing else.
+                if (!code.empty())
+                    add_row(exp, code, tree_id, fields);
+                in_tree = false;
+                break;
+            }
+            if (!has_content.back())
+            {
+                Field field;
+                field.path = path;
+                field.kind = FIELD_FLAG;
+                field.value = 0;
+                fields.push_back(field);
+            }
+            has_content.pop_back();
+            path.resize(path_lengths.back());
+            path_lengths.pop_back();
+            break;
+        case VOMITORIUM_TOKEN_NONE:
+            abort();
+        }
+    }
+    resolve_string_refs(exp);
+    bool ok = vomitorium_tokens_complete(tokens);
+    vomitorium_tokens_end(tokens);
+    return ok;
+}
+
+
+static void write_file(const std::string& path, const std::string& data)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+        die(path.c_str(), "unable to open");
+    fwrite(data.data(), 1, data.size(), f);
+    if (fclose(f) != 0)
+        die(path.c_str(), "failed to write");
+}
+
+static void put_le32(std::string *out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        out->push_back((char)(v >> (8 * i)));
+}
+
+static void make_dir(const std::string& path)
+{
+    if (mkdir(path.c_str(), 0777) == -1 && errno != EEXIST)
+        die(path.c_str(), strerror(errno));
+}
+
+static void write_column(const std::string& base, size_t rows, Column& col, FILE *manifest, const char *code, const char *field)
+{
+    col.counts.resize(rows, 0);
+    bool list = col.repeats();
+
+    std::string data;
+    const char *kind;
+    if (col.only(FIELD_FLAG) && !list)
+    {
+        kind = "bits";
+        data.resize((rows + 7) / 8, 0);
+        for (size_t i = 0; i < rows; ++i)
+            if (col.counts[i])
+                data[i / 8] |= 1 << (i % 8);
+    }
+    else
+    {
+        // With a list, absent values just aren't there.
+        bool refs = col.only(FIELD_REF);
+        bool numbers = col.only(FIELD_U32);
+        kind = refs ? "refs" : numbers ? "u32" : "strings";
+        size_t v = 0;
+        for (size_t i = 0; i < rows; ++i)
+        {
+            size_t n = col.counts[i];
+            if (!n && !list)
+            {
+                if (refs)
+                    put_le64(&data, BINARY_TREE_ABSENT);
+                else
+                    put_le32(&data, numbers ? ABSENT_U32 : ABSENT_STRING);
+                continue;
+            }
+            for (; n; --n, ++v)
+            {
+                if (refs)
+                    put_le64(&data, col.values[v]);
+                else
+                    put_le32(&data, col.values[v]);
+            }
+        }
+    }
+    write_file(base + "." + kind, data);
+
+    size_t values = col.values.size();
+    if (list)
+    {
+        std::string offsets;
+        uint64_t total = 0;
+        put_le64(&offsets, 0);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            total += col.counts[i];
+            put_le64(&offsets, total);
+        }
+        write_file(base + ".offsets", offsets);
+    }
+    fprintf(manifest, "%s\t%s\t%s%s\t%zu\t%zu\n", code, field, kind, list ? "[]" : "", rows, values);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s OUTPUT-DIR DUMP.xml...\n", argv[0]);
+        return 2;
+    }
+    std::string dir = argv[1];
+
+    Exporter exp;
+    for (int i = 2; i < argc; ++i)
+    {
+        vomitorium_reader *reader = vomitorium_reader_open(argv[i]);
+        if (!reader)
+            die(argv[i], strerror(errno));
+        if (!read_trees(&exp, reader))
+            die(argv[i], "malformed XML");
+        vomitorium_reader_close(reader);
+    }
+
+    // Mixed columns, and lists of flags, become strings: references as
+    // "@N", numbers in decimal and flags as "". That has to happen before
+    // the dictionary is written.
+    for (auto t = exp.tables.begin(); t != exp.tables.end(); ++t)
+    {
+        for (auto c = t->second.columns.begin(); c != t->second.columns.end(); ++c)
+        {
+            Column& col = c->second;
+            if (col.only(FIELD_REF) || col.only(FIELD_STRING) || col.only(FIELD_U32) || (col.only(FIELD_FLAG) && !col.repeats()))
+                continue;
+            for (size_t v = 0; v < col.values.size(); ++v)
+            {
+                if (col.kinds[v] == FIELD_REF)
+                {
+                    char buf[24];
+                    snprintf(buf, sizeof(buf), "@%" PRIu64, col.values[v]);
+                    col.values[v] = intern_string(&exp, buf);
+                }
+                if (col.kinds[v] == FIELD_U32)
+                    col.values[v] = intern_string(&exp, std::to_string(col.values[v]));
+                if (col.kinds[v] == FIELD_FLAG)
+                    col.values[v] = intern_string(&exp, "");
+                col.kinds[v] = FIELD_STRING;
+            }
+        }
+    }
+
+    make_dir(dir);
+    std::string strings;
+    for (size_t i = 0; i < exp.strings.size(); ++i)
+    {
+        put_le32(&strings, exp.strings[i].size());
+        strings += exp.strings[i];
+    }
+    write_file(dir + "/strings", strings);
+
+    std::string manifest_path = dir + "/columns.tsv";
+    FILE *manifest = fopen(manifest_path.c_str(), "w");
+    if (!manifest)
+        die(manifest_path.c_str(), "unable to open");
+    size_t trees = 0;
+    for (auto t = exp.tables.begin(); t != exp.tables.end(); ++t)
+    {
+        const std::string& code = t->first;
+        Table& table = t->second;
+        std::string table_dir = dir + "/" + code;
+        make_dir(table_dir);
+
+        size_t rows = table.ids.size();
+        trees += rows;
+        std::string ids;
+        for (size_t i = 0; i < rows; ++i)
+            put_le64(&ids, table.ids[i]);
+        write_file(table_dir + "/ids", ids);
+        fprintf(manifest, "%s\tids\trefs\t%zu\t%zu\n", code.c_str(), rows, rows);
+
+        for (auto c = table.columns.begin(); c != table.columns.end(); ++c)
+            write_column(table_dir + "/" + c->first, rows, c->second, manifest, code.c_str(), c->first.c_str());
+    }
+    if (fclose(manifest) != 0)
+        die(manifest_path.c_str(), "failed to write");
+
+    fprintf(stderr, "%s: %zu trees, %zu codes, %zu strings\n", dir.c_str(), trees, exp.tables.size(), exp.strings.size());
+    return 0;
+}
@@ -0,0 +1,480 @@
+// Convert v1 XML dumps into the compact binary format; see binary.hpp.
+// DO NOT INCLUDE ANY GCC HEADERS
+//
+// The records are split into chunks at <tree> boundaries, and each chunk
+// becomes one independent block, so all of them are parsed in parallel.
+// Blocks are written in order, so tree ids and everything else stay the same.
+
+#include "vomitorium-reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "binary.hpp"
+#include "compat.hpp"
+
+
+// How many converted chunks may wait to be written.
+#define CHUNK_WINDOW 4
+
+struct Chunk
+{
+    size_t offset;
+    size_t length;
+    bool done;
+    bool ok;
+    std::string out;
+    // (tree id, offset of its OP_START within `out`)
+    std::vector<std::pair<uint64_t, size_t>> trees;
+    // Whether those go in the tree table. Some ids in GIMPLE and RTL
+    // records are local to them, so only <vomitorium-dump>'s do.
+    bool table_trees;
+    // Where `out` ended up, for verification.
+    size_t written_offset;
+    size_t written_length;
+};
+
+struct Converter
+{
+    vomitorium_reader *reader;
+    size_t chunk_size;
+    std::vector<Chunk> chunks;
+
+    std::atomic<size_t> next_chunk;
+    std::mutex lock;
+    std::condition_variable changed;
+    size_t written;
+};
+
+
+static void die(const char *path, const char *what)
+{
+    fprintf(stderr, "%s: %s\n", path, what);
+    exit(1);
+}
+
+static bool is_tree_start(const char *line, const char *p)
+{
+    for (; line < p; ++line)
+        if (*line != ' ')
+            return false;
+    return true;
+}
+
+// Split [begin, end) just before lines that start a <tree>.
+static void split_record(Converter *conv, const char *data, size_t offset, size_t length, bool table_trees)
+{
+    const char *p = data + offset;
+    const char *end = p + length;
+    while (p < end)
+    {
+        const char *q = end;
+        for (const char *s = p + conv->chunk_size; (size_t)(end - p) > conv->chunk_size && s < end; )
+        {
+            const char *t = (const char *)memmem(s, end - s, "<tree id=", 9);
+            if (!t)
+                break;
+            const char *line = t;
+            while (line > p && line[-1] != '\n')
+                --line;
+            // Not right at p, or the chunk would be empty.
+            if (line > p + 1 && is_tree_start(line, t))
+            {
+                q = line - 1;
+                break;
+            }
+            s = t + 1;
+        }
+
+        Chunk chunk;
+        chunk.offset = p - data;
+        chunk.length = q - p;
+        chunk.done = false;
+        chunk.ok = false;
+        chunk.table_trees = table_trees;
+        chunk.written_offset = 0;
+        chunk.written_length = 0;
+        conv->chunks.push_back(chunk);
+        p = q;
+    }
+}
+
+
+// A reference, spelled exactly the way it would be written back.
+static bool canonical_ref(vomitorium_string_view v, uint64_t *id)
+{
+    if (v.len < 2 || v.len > 19 || (v.len > 2 && v.data[1] == '0'))
+        return false;
+    size_t n;
+    if (!vomitorium_reader_tree_ref(v, &n))
+        return false;
+    *id = n;
+    return true;
+}
+
+static void put_value(std::string *out, std::string *scratch, vomitorium_string_view v)
+{
+    uint64_t id;
+    if (canonical_ref(v, &id))
+    {
+        put_leb128(out, id << 1 | 1);
+        return;
+    }
+    scratch->resize(v.len);
+    size_t len = v.len ? vomitorium_reader_unescape(v, &(*scratch)[0]) : 0;
+    put_leb128(out, (uint64_t)len << 1);
+    out->append(scratch->data(), len);
+}
+
+// Collects the OP_NAMEs that go at the start of the block.
+class NameTable
+{
+    std::unordered_map<std::string, uint64_t> ids;
+    std::string key;
+public:
+    std::string defs;
+
+    uint64_t get(vomitorium_string_view name)
+    {
+        this->key.assign(name.data, name.len);
+        auto it = this->ids.find(this->key);
+        if (it != this->ids.end())
+            return it->second;
+        uint64_t id = this->ids.size();
+        this->ids[this->key] = id;
+        this->defs.push_back(OP_NAME);
+        put_leb128(&this->defs, name.len);
+        this->defs.append(name.data, name.len);
+        return id;
+    }
+};
+
+static void encode_chunk(vomitorium_reader *reader, Chunk *chunk)
+{
+    std::string& out = chunk->out;
+    std::string scratch;
+    NameTable names;
+    out.reserve(chunk->length / 2);
+
+    vomitorium_tokens *tokens = vomitorium_reader_range_tokens(reader, chunk->offset, chunk->length);
+    vomitorium_token token;
+    vomitorium_token_init(&token);
+    while (vomitorium_tokens_next(tokens, &token))
+    {
+        switch (token.kind)
+        {
+        case VOMITORIUM_TOKEN_START:
+            {
+                uint64_t tag = names.get(token.tag);
+                uint64_t attr = token.attr.len ? names.get(token.attr) + 1 : 0;
+                uint64_t id;
+                if (token.tag.len == 4 && memcmp(token.tag.data, "tree", 4) == 0
+                        && token.attr.len == 2 && memcmp(token.attr.data, "id", 2) == 0
+                        && canonical_ref(token.value, &id))
+                    chunk->trees.push_back(std::make_pair(id, out.size()));
+                out.push_back(OP_START);
+                put_leb128(&out, tag);
+                put_leb128(&out, attr);
+                if (attr)
+                    put_value(&out, &scratch, token.value);
+            }
+            break;
+        case VOMITORIUM_TOKEN_TEXT:
+            out.push_back(OP_TEXT);
+            put_value(&out, &scratch, token.text);
+            break;
+        case VOMITORIUM_TOKEN_END:
+            out.push_back(OP_END);
+            break;
+        case VOMITORIUM_TOKEN_NONE:
+            abort();
+        }
+    }
+    chunk->ok = vomitorium_tokens_complete(tokens);
+    vomitorium_tokens_end(tokens);
+
+    names.defs.insert(names.defs.begin(), (char)OP_BLOCK);
+    out.insert(0, names.defs);
+    for (size_t i = 0; i < chunk->trees.size(); ++i)
+        chunk->trees[i].second += names.defs.size();
+}
+
+static void worker(Converter *conv)
+{
+    while (true)
+    {
+        size_t i = conv->next_chunk++;
+        if (i >= conv->chunks.size())
+            return;
+        {
+            std::unique_lock<std::mutex> guard(conv->lock);
+            while (i >= conv->written + CHUNK_WINDOW)
+                conv->changed.wait(guard);
+        }
+        encode_chunk(conv->reader, &conv->chunks[i]);
+        {
+            std::lock_guard<std::mutex> guard(conv->lock);
+            conv->chunks[i].done = true;
+        }
+        conv->changed.notify_all();
+    }
+}
+
+
+// Compare one block with the XML it came from, token for token.
+static bool same_value(vomitorium_string_view xml, const BinaryEvent& event, std::string *scratch)
+{
+    if (event.is_ref)
+    {
+        char buf[24];
+        int n = snprintf(buf, sizeof(buf), "@%" PRIu64, event.ref);
+        return xml.len == (size_t)n && memcmp(xml.data, buf, n) == 0;
+    }
+    scratch->resize(xml.len);
+    size_t len = xml.len ? vomitorium_reader_unescape(xml, &(*scratch)[0]) : 0;
+    return len == event.str_len && memcmp(scratch->data(), event.str, len) == 0;
+}
+
+static bool same_view(vomitorium_string_view v, const char *data, size_t len)
+{
+    return v.len == len && memcmp(v.data, data, len) == 0;
+}
+
+static bool verify_chunk(vomitorium_reader *reader, const Chunk& chunk, const uint8_t *bin)
+{
+    std::string scratch;
+    BinaryDecoder decoder(bin + chunk.written_offset, bin + chunk.written_offset + chunk.written_length);
+    BinaryEvent event;
+    vomitorium_tokens *tokens = vomitorium_reader_range_tokens(reader, chunk.offset, chunk.length);
+    vomitorium_token token;
+    vomitorium_token_init(&token);
+
+    bool ok = true;
+    while (ok && vomitorium_tokens_next(tokens, &token))
+    {
+        if (!decoder.next(&event))
+        {
+            ok = false;
+            break;
+        }
+        switch (token.kind)
+        {
+        case VOMITORIUM_TOKEN_START:
+            ok = event.op == OP_START && same_view(token.tag, event.name, event.name_len);
+            if (ok && token.attr.len)
+                ok = event.attr && same_view(token.attr, event.attr, event.attr_len) && same_value(token.value, event, &scratch);
+            else if (ok)
+                ok = !event.attr;
+            break;
+        case VOMITORIUM_TOKEN_TEXT:
+            ok = event.op == OP_TEXT && same_value(token.text, event, &scratch);
+            break;
+        case VOMITORIUM_TOKEN_END:
+            ok = event.op == OP_END;
+            break;
+        case VOMITORIUM_TOKEN_NONE:
+            abort();
+        }
+    }
+    if (ok)
+        ok = !decoder.next(&event) && !decoder.failed();
+    vomitorium_tokens_end(tokens);
+    return ok;
+}
+
+// Every tree in the table must point at its own <tree id="@N">.
+static bool verify_trees(const Chunk& chunk, const uint8_t *bin, size_t size, const uint8_t *table)
+{
+    if (!chunk.table_trees)
+        return true;
+    for (size_t i = 0; i < chunk.trees.size(); ++i)
+    {
+        uint64_t id = chunk.trees[i].first;
+        uint64_t block = get_le64(table + 16 * id);
+        uint64_t offset = get_le64(table + 16 * id + 8);
+        if (block >= size || offset >= size)
+            return false;
+        BinaryDecoder decoder(bin, bin + size);
+        BinaryEvent event;
+        if (!decoder.seek(bin + block, bin + offset) || !decoder.next(&event) || event.op != OP_START || !event.is_ref || event.ref != id)
+            return false;
+    }
+    return true;
+}
+
+
+int main(int argc, char **argv)
+{
+    size_t threads = std::thread::hardware_concurrency();
+    size_t verify = 8;
+    // Big enough that the per-block name table doesn't matter.
+    size_t chunk_size = 4 << 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:j:v:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            chunk_size = strtoul(optarg, nullptr, 10);
+            break;
+        case 'j':
+            threads = strtoul(optarg, nullptr, 10);
+            break;
+        case 'v':
+            verify = strtoul(optarg, nullptr, 10);
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        fprintf(stderr, "Usage: %s [-c CHUNK-BYTES] [-j THREADS] [-v VERIFY-CHUNKS] DUMP.xml OUTPUT\n", argv[0]);
+        return 2;
+    }
+    if (!threads)
+        threads = 1;
+    if (!chunk_size)
+        chunk_size = 1;
+    const char *in_path = argv[optind];
+    const char *out_path = argv[optind + 1];
+
+    Converter conv;
+    conv.chunk_size = chunk_size;
+    conv.reader = vomitorium_reader_open(in_path);
+    if (!conv.reader)
+        die(in_path, strerror(errno));
+    const char *data = vomitorium_reader_data(conv.reader).data;
+    size_t records = vomitorium_reader_record_count(conv.reader);
+    if (!records)
+        die(in_path, "no records");
+    for (size_t i = 0; i < records; ++i)
+    {
+        vomitorium_record record;
+        vomitorium_record_init(&record);
+        vomitorium_reader_record(conv.reader, i, &record);
+        bool table_trees = same_view(record.tag, "vomitorium-dump", strlen("vomitorium-dump"));
+        split_record(&conv, data, record.offset, record.length, table_trees);
+    }
+    conv.next_chunk = 0;
+    conv.written = 0;
+
+    FILE *out = fopen(out_path, "wb");
+    if (!out)
+        die(out_path, "unable to open");
+
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < threads && i < conv.chunks.size(); ++i)
+        pool.push_back(std::thread(worker, &conv));
+
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.version = BINARY_VERSION;
+    fwrite(&header, sizeof(header), 1, out);
+    size_t offset = sizeof(header);
+
+    // Pairs of block and tree offsets.
+    std::vector<uint64_t> tree_offsets;
+    bool ok = true;
+    for (size_t i = 0; i < conv.chunks.size(); ++i)
+    {
+        Chunk& chunk = conv.chunks[i];
+        {
+            std::unique_lock<std::mutex> guard(conv.lock);
+            while (!chunk.done)
+                conv.changed.wait(guard);
+        }
+        if (!chunk.ok)
+        {
+            fprintf(stderr, "%s: malformed XML in bytes %zu to %zu\n", in_path, chunk.offset, chunk.offset + chunk.length);
+            ok = false;
+        }
+        for (size_t t = 0; chunk.table_trees && t < chunk.trees.size(); ++t)
+        {
+            uint64_t id = chunk.trees[t].first;
+            if (2 * id >= tree_offsets.size())
+                tree_offsets.resize(2 * id + 2, BINARY_TREE_ABSENT);
+            tree_offsets[2 * id] = offset;
+            tree_offsets[2 * id + 1] = offset + chunk.trees[t].second;
+        }
+        fwrite(chunk.out.data(), 1, chunk.out.size(), out);
+        chunk.written_offset = offset;
+        chunk.written_length = chunk.out.size();
+        offset += chunk.out.size();
+        std::string().swap(chunk.out);
+        {
+            std::lock_guard<std::mutex> guard(conv.lock);
+            conv.written = i + 1;
+        }
+        conv.changed.notify_all();
+    }
+    for (size_t i = 0; i < pool.size(); ++i)
+        pool[i].join();
+
+    std::string table;
+    for (size_t i = 0; i < tree_offsets.size(); ++i)
+        put_le64(&table, tree_offsets[i]);
+    BinaryFooter footer;
+    footer.tree_table_offset = offset;
+    footer.tree_count = tree_offsets.size() / 2;
+    memcpy(footer.magic, BINARY_FOOTER_MAGIC, sizeof(footer.magic));
+    fwrite(table.data(), 1, table.size(), out);
+    fwrite(&footer, sizeof(footer), 1, out);
+    if (fclose(out) != 0)
+        die(out_path, "failed to write");
+    if (!ok)
+        return 1;
+
+    // Read back what was written, rather than trusting the buffers.
+    if (verify)
+    {
+        int fd = open(out_path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd == -1 || fstat(fd, &st) == -1)
+            die(out_path, strerror(errno));
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+            die(out_path, strerror(errno));
+        close(fd);
+        const uint8_t *bin = (const uint8_t *)map;
+        const uint8_t *tree_table = bin + footer.tree_table_offset;
+
+        // Spread evenly, always including the first and last.
+        size_t n = conv.chunks.size();
+        size_t samples = verify < n ? verify : n;
+        for (size_t s = 0; s < samples; ++s)
+        {
+            size_t i = samples == 1 ? 0 : s * (n - 1) / (samples - 1);
+            const Chunk& chunk = conv.chunks[i];
+            if (!verify_chunk(conv.reader, chunk, bin) || !verify_trees(chunk, bin, footer.tree_table_offset, tree_table))
+            {
+                fprintf(stderr, "%s: does not match %s in bytes %zu to %zu\n", out_path, in_path, chunk.offset, chunk.offset + chunk.length);
+                ok = false;
+            }
+        }
+        munmap(map, st.st_size);
+    }
+
+    fprintf(stderr, "%s: %zu bytes, %zu blocks, %zu tree ids; %s: %zu bytes\n",
+            in_path, vomitorium_reader_data(conv.reader).len, conv.chunks.size(), tree_offsets.size() / 2, out_path, (size_t)(offset + table.size() + sizeof(footer)));
+    vomitorium_reader_close(conv.reader);
+    return ok ? 0 : 1;
+}
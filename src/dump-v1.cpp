@@ -2,22 +2,32 @@
 
 #include <cassert>
 
+#include <algorithm>
 #include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "buffer.hpp"
+#include "index.hpp"
 #include "intern.hpp"
 #include "iter.hpp"
 #include "names.hpp"
 #include "traits.hpp"
 #include "xml.hpp"
 
+#include "vgcc/basic-block.h"
 #include "vgcc/c-family/c-common.h"
 #include "vgcc/c-family/c-pragma.h"
 #include "vgcc/c-tree.h"
 #include "vgcc/cilk.h"
 #include "vgcc/debug.h"
+#include "vgcc/emit-rtl.h"
 #include "vgcc/expr.h"
 #include "vgcc/fixed-value.h"
+#include "vgcc/gimple-iterator.h"
+#include "vgcc/gimple.h"
 #include "vgcc/langhooks.h"
 #include "vgcc/omp-low.h"
 #include "vgcc/omp-offload.h"
@@ -33,13 +43,87 @@
 
 static size_t incomplete_dumps = 0;
 
+// Top-level elements are records, for the trailing index.
+struct RecordSpan
+{
+    size_t offset;
+    size_t length;
+    const char *tag;
+};
+
+// Where a <tree> starts, for the trailing index.
+struct TreeSpan
+{
+    size_t id;
+    size_t offset;
+};
+
+// Everything that goes to one output file. Normally there's just the
+// main one, but with -fplugin-arg-vomitorium-dump-shards, trees go to
+// separate files according to their TREE_CODE_CLASS.
+struct Stream
+{
+    OutputBuffer *buffer;
+    XmlOutput *xml;
+    std::vector<RecordSpan> record_spans;
+    // Records are read on their own, so they never nest.
+    bool in_record;
+    // Whether this stream gets a tree index: the main one only with
+    // -fplugin-arg-vomitorium-index, but shards always.
+    bool index_trees;
+    // In the order they were dumped, so a tree that was dumped again
+    // comes after its earlier dump.
+    std::vector<TreeSpan> tree_spans;
+    // Only with -fplugin-arg-vomitorium-string-table. The pending ones
+    // point into the keys of `string_ids`.
+    std::unordered_map<std::string, size_t> string_ids;
+    std::vector<std::pair<size_t, const char *>> pending_strings;
+    // Only with -fplugin-arg-vomitorium-location-delta.
+    bool have_last_location;
+    expanded_location last_location;
+
+    Stream(OutputBuffer *b, XmlOutput *x) : buffer(b), xml(x), in_record(false), index_trees(false), have_last_location(false)
+    {
+    }
+};
+
 // FIXME: this currently needs to be a lazy global.
+static Stream& get_main_stream()
+{
+    static XmlOutput global_output(&get_output_buffer());
+    static Stream main_stream(&get_output_buffer(), &global_output);
+    return main_stream;
+}
+
+// Where dump_tree() and friends are writing to right now.
+static Stream *current_stream;
+
+static Stream& get_stream()
+{
+    return current_stream ? *current_stream : get_main_stream();
+}
+
 static XmlOutput& get_xml_output()
 {
-    static XmlOutput global_output(vomitorium_output, false);
-    return global_output;
+    return *get_stream().xml;
 }
 
+class StreamSwitch
+{
+    Stream *saved;
+public:
+    StreamSwitch(Stream *stream) : saved(current_stream)
+    {
+        current_stream = stream;
+    }
+    StreamSwitch(const StreamSwitch&) = delete;
+    StreamSwitch& operator = (const StreamSwitch&) = delete;
+    ~StreamSwitch()
+    {
+        current_stream = this->saved;
+    }
+};
+
 // forbid implicit conversions
 template<class T, typename=void>
 struct XmlEmitter;
@@ -86,6 +170,48 @@ public:
     }
 };
 
+// See string_table, below.
+static void emit_pending_strings();
+
+// The span is a base class so that it ends only after the root tag
+// has been closed.
+class RecordBounds
+{
+    Stream *stream;
+    const char *tag;
+    size_t offset;
+protected:
+    RecordBounds(const char *t) : stream(&get_stream()), tag(t)
+    {
+        assert (!this->stream->in_record);
+        this->stream->in_record = true;
+        // get_stream() made sure the <?xml?> line isn't counted as part of us.
+        this->offset = this->stream->buffer->tell();
+        // Records can be read on their own, so don't depend on earlier ones.
+        this->stream->have_last_location = false;
+    }
+    ~RecordBounds()
+    {
+        this->stream->string_ids.clear();
+        this->stream->in_record = false;
+        RecordSpan span = {this->offset, this->stream->buffer->tell() - this->offset, this->tag};
+        this->stream->record_spans.push_back(span);
+    }
+};
+
+class Record : RecordBounds
+{
+    Xml root;
+public:
+    Record(const char *t) : RecordBounds(t), root(t, "version", 1)
+    {
+    }
+    ~Record()
+    {
+        emit_pending_strings();
+    }
+};
+
 template<class T>
 static void xml1(const char *tag, T v)
 {
@@ -121,12 +247,9 @@ struct XmlEmitter<T, typename std::enable_if<std::is_integral<T>::value && std::
 {
     static void do_xemit(T obj)
     {
-        get_xml_output().with_output_file(
-            [=](FILE *out)
-            {
-                fprintf(out, "%ju", (uintmax_t)obj);
-            }
-        );
+        char buf[24];
+        int len = snprintf(buf, sizeof(buf), "%ju", (uintmax_t)obj);
+        get_xml_output().emit_raw(buf, len);
     }
 };
 template<class T>
@@ -134,12 +257,9 @@ struct XmlEmitter<T, typename std::enable_if<std::is_integral<T>::value && std::
 {
     static void do_xemit(T obj)
     {
-        get_xml_output().with_output_file(
-            [=](FILE *out)
-            {
-                fprintf(out, "%jd", (uintmax_t)obj);
-            }
-        );
+        char buf[24];
+        int len = snprintf(buf, sizeof(buf), "%jd", (intmax_t)obj);
+        get_xml_output().emit_raw(buf, len);
     }
 };
 
@@ -389,12 +509,42 @@ struct XmlEmitter<enum omp_clause_linear_kind>
 #endif
 // it turns out we don't need to convert to this.
 
+// GCC's printers for big integers only write to a FILE. Writing them to
+// vomitorium_output directly would put them ahead of whatever is still
+// buffered, leave them out of tell() (so the index would be off), and
+// bypass compression and mmap-output. Print into memory and emit that.
+class CapturedFile
+{
+    char *data;
+    size_t size;
+public:
+    FILE *file;
+
+    CapturedFile()
+    : data(nullptr)
+    , size(0)
+    , file(open_memstream(&this->data, &this->size))
+    {
+        if (!this->file)
+            abort();
+    }
+    CapturedFile(const CapturedFile&) = delete;
+    CapturedFile& operator = (const CapturedFile&) = delete;
+    ~CapturedFile()
+    {
+        fclose(this->file);
+        get_xml_output().emit_raw(this->data, this->size);
+        free(this->data);
+    }
+};
+
 template<>
 struct XmlEmitter<typename std::decay<const mpz_t>::type>
 {
     static void do_xemit(const mpz_t obj)
     {
-        gmp_fprintf(vomitorium_output, "%Zd", obj);
+        CapturedFile out;
+        gmp_fprintf(out.file, "%Zd", obj);
     }
 };
 // Note: this always outputs as signed, since that is shorter.
@@ -418,7 +568,10 @@ struct XmlEmitter<double_int>
         }
         else
         {
-            dump_double_int(vomitorium_output, obj, false);
+            {
+                CapturedFile out;
+                dump_double_int(out.file, obj, false);
+            }
             if (0)
             {
                 mpz_t val;
@@ -444,7 +597,10 @@ struct XmlEmitter<wide_int_ref>
         }
         else
         {
-            print_decs(obj, vomitorium_output);
+            {
+                CapturedFile out;
+                print_decs(obj, out.file);
+            }
             if (0)
             {
                 mpz_t val;
@@ -487,13 +643,114 @@ struct XmlEmitter<struct fixed_value>
     }
 };
 
+// With -fplugin-arg-vomitorium-string-table, identifier names and file
+// names are written as `$N` instead. The table starts over with each
+// record, so that records stay independent; a record defines each of its
+// N exactly once, with a <string id="$N"> after the <tree> that first
+// used it, or at the end of the record.
+static bool string_table;
+
+struct StringRef
+{
+    size_t id;
+};
+
+template<>
+struct XmlEmitter<StringRef>
+{
+    static void do_xemit(StringRef obj)
+    {
+        xemit("$");
+        xemit(obj.id);
+    }
+};
+
+static StringRef intern_string(const char *s)
+{
+    Stream& stream = get_stream();
+    auto it = stream.string_ids.find(s);
+    if (it == stream.string_ids.end())
+    {
+        it = stream.string_ids.insert(std::make_pair(std::string(s), stream.string_ids.size())).first;
+        stream.pending_strings.push_back(std::make_pair(it->second, it->first.c_str()));
+    }
+    StringRef ref = {it->second};
+    return ref;
+}
+
+static void emit_pending_strings()
+{
+    Stream& stream = get_stream();
+    for (size_t i = 0; i < stream.pending_strings.size(); ++i)
+    {
+        StringRef ref = {stream.pending_strings[i].first};
+        Xml xml("string", "id", ref);
+        xemit(stream.pending_strings[i].second);
+    }
+    stream.pending_strings.clear();
+}
+
+// expand_location() is a binary search through the line maps, but
+// the same few locations come up over and over.
+#define LOCATION_CACHE_BITS 12
+static struct
+{
+    bool valid;
+    location_t loc;
+    expanded_location expanded;
+} location_cache[1 << LOCATION_CACHE_BITS];
+
+static expanded_location expand_location_cached(location_t loc)
+{
+    // Fibonacci hashing, since nearby locations differ in the low bits.
+    auto& entry = location_cache[(uint32_t)(loc * 2654435769u) >> (32 - LOCATION_CACHE_BITS)];
+    if (!entry.valid || entry.loc != loc)
+    {
+        entry.valid = true;
+        entry.loc = loc;
+        entry.expanded = expand_location(loc);
+    }
+    return entry.expanded;
+}
+
+// With -fplugin-arg-vomitorium-location-delta, a location in the same
+// file as the previous one in the stream is written as `:+LINES:COLUMN`
+// (or `:-LINES:COLUMN`) relative to that one's line. That starts over
+// at each record, and at each <tree> if there is an index, so that
+// anything that can be found on its own can also be decoded on its own.
+static bool location_delta;
+
+static bool same_file(const char *a, const char *b)
+{
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
 template<>
 struct XmlEmitter<expanded_location>
 {
     static void do_xemit(expanded_location obj)
     {
+        if (location_delta)
+        {
+            Stream& stream = get_stream();
+            bool delta = stream.have_last_location && same_file(obj.file, stream.last_location.file);
+            int lines = obj.line - stream.last_location.line;
+            stream.have_last_location = true;
+            stream.last_location = obj;
+            if (delta)
+            {
+                xemit(lines < 0 ? ":" : ":+");
+                xemit(lines);
+                xemit(":");
+                xemit(obj.column);
+                return;
+            }
+        }
         xemit(obj.sysp ? "<" : "\"");
-        xemit(obj.file ?: "(null)");
+        if (string_table && obj.file)
+            xemit(intern_string(obj.file));
+        else
+            xemit(obj.file ?: "(null)");
         xemit(obj.sysp ? ">" : "\"");
         xemit(":");
         xemit(obj.line);
@@ -507,30 +764,70 @@ struct XmlEmitter<source_range>
 {
     static void do_xemit(source_range obj)
     {
-        xml1("start", expand_location(obj.m_start));
-        xml1("finish", expand_location(obj.m_finish));
+        xml1("start", expand_location_cached(obj.m_start));
+        xml1("finish", expand_location_cached(obj.m_finish));
     }
 };
 #endif
 
-// TODO implement these dumpers
+// rtxes get their own table, since they aren't trees. They are written
+// as %N, and their bodies are only dumped by the RTL mode, which starts
+// the table over for every function (see dump_rtl_function).
+static std::vector<const_rtx> interned_rtx_list = {NULL_RTX};
+static std::map<const_rtx, size_t> interned_rtx_ids = {{NULL_RTX, 0}};
+
+static void reset_rtx_table()
+{
+    interned_rtx_list.assign(1, NULL_RTX);
+    interned_rtx_ids.clear();
+    interned_rtx_ids.insert(std::make_pair(NULL_RTX, 0));
+}
+
+static size_t intern_rtx(const_rtx x)
+{
+    auto pair = interned_rtx_ids.insert(std::make_pair(x, interned_rtx_ids.size()));
+    if (pair.second)
+        interned_rtx_list.push_back(x);
+    return pair.first->second;
+}
+
 template<>
 struct XmlEmitter<const_rtx>
 {
     static void do_xemit(const_rtx obj)
     {
-        (void)obj;
-        xemit("NYI: rtx");
+        xemit("%");
+        xemit(intern_rtx(obj));
     }
 };
 
+// Operands are just references into the same @N table as everything else.
 template<>
 struct XmlEmitter<const_gimple_ptr>
 {
     static void do_xemit(const_gimple_ptr obj)
     {
-        (void)obj;
-        xemit("NYI: gimple");
+        if (!obj)
+            return;
+        enum gimple_code code = gimple_code(obj);
+        Xml stmt("gimple", "code", gimple_code_name[code]);
+        xml1("location", expand_location_cached(gimple_location(obj)));
+        if (code == GIMPLE_ASSIGN)
+            xml1("rhs-code", get_tree_code_name(gimple_assign_rhs_code(obj)));
+        if (code == GIMPLE_COND)
+            xml1("cond-code", get_tree_code_name(gimple_cond_code(obj)));
+        if (code == GIMPLE_PHI)
+        {
+            // PHI arguments aren't operands.
+            gimple_ptr phi = CONST_CAST_GIMPLE(obj);
+            xml1("result", (const_tree)gimple_phi_result(phi));
+            size_t n = gimple_phi_num_args(phi);
+            for (size_t i = 0; i < n; ++i)
+                xml1("arg", (const_tree)gimple_phi_arg_def(phi, i));
+        }
+        unsigned n = gimple_num_ops(obj);
+        for (unsigned i = 0; i < n; ++i)
+            xml1("op", (const_tree)gimple_op(obj, i));
     }
 };
 #if !V(4, 8)
@@ -539,8 +836,8 @@ struct XmlEmitter<const_gimple_seq>
 {
     static void do_xemit(const_gimple_seq obj)
     {
-        (void)obj;
-        xemit("NYI: gimple_seq");
+        for (gimple_stmt_iterator gsi = gsi_start(CONST_CAST(gimple_seq, obj)); !gsi_end_p(gsi); gsi_next(&gsi))
+            xemit((const_gimple_ptr)gsi_stmt(gsi));
     }
 };
 // otherwise, the same as gimple
@@ -1204,6 +1501,13 @@ static void dump_tree(const_tree orig_tree)
     //  * dump_tree_by_code()
     // each of which should use the .def files to switch() to a template.
     // TODO write `fake_tree` function for things that don't want a `code`.
+    // A scoped id isn't one the index could find.
+    if (get_stream().index_trees && !InternScope::active())
+    {
+        get_stream().have_last_location = false;
+        TreeSpan span = {intern(orig_tree), get_xml_output().prepare_tag()};
+        get_stream().tree_spans.push_back(span);
+    }
     if (!orig_tree)
     {
         xml0("tree", "id", orig_tree);
@@ -1861,7 +2165,10 @@ static void dump_tree(const_tree orig_tree)
         unsigned int hash_value = TAKE1(IDENTIFIER_HASH_VALUE);
         {
             Xml xml("name", "hash", hash_value);
-            xemit(ptr);
+            if (string_table)
+                xemit(intern_string(ptr));
+            else
+                xemit(ptr);
         }
         switch (vomitorium_current_frontend)
         {
@@ -2173,7 +2480,7 @@ static void dump_tree(const_tree orig_tree)
 
         if (EXPR_HAS_LOCATION(orig_tree))
         {
-            xml1("location", expand_location(TAKE2(EXPR_LOCATION, SET_EXPR_LOCATION)));
+            xml1("location", expand_location_cached(TAKE2(EXPR_LOCATION, SET_EXPR_LOCATION)));
 #if V(6)
             xml1("range", EXPR_LOCATION_RANGE(CONST_CAST_TREE(orig_tree)));
 #endif
@@ -2212,7 +2519,7 @@ static void dump_tree(const_tree orig_tree)
             operand_names[_i] = name;                               \
         })
         if (OMP_CLAUSE_HAS_LOCATION(orig_tree))
-            xml1("location", expand_location(TAKE1(OMP_CLAUSE_LOCATION)));
+            xml1("location", expand_location_cached(TAKE1(OMP_CLAUSE_LOCATION)));
         xml1("clause-code", omp_code);
 
         if (omp_code >= OMP_CLAUSE_PRIVATE && omp_code <=
@@ -2488,9 +2795,9 @@ static void dump_tree(const_tree orig_tree)
         DO_VAL("number", BLOCK_NUMBER);
         DO_VAL("fragment-origin", BLOCK_FRAGMENT_ORIGIN);
         DO_VAL("fragment-chain", BLOCK_FRAGMENT_CHAIN);
-        xml1("source-location", expand_location(TAKE1(BLOCK_SOURCE_LOCATION)));
+        xml1("source-location", expand_location_cached(TAKE1(BLOCK_SOURCE_LOCATION)));
 #if V(5)
-        xml1("source-end-location", expand_location(TAKE1(BLOCK_SOURCE_LOCATION)));
+        xml1("source-end-location", expand_location_cached(TAKE1(BLOCK_SOURCE_LOCATION)));
 #endif
 #if V(6)
         DO_VAL("die", BLOCK_DIE);
@@ -2821,7 +3128,7 @@ static void dump_tree(const_tree orig_tree)
         DO_VAL("name", DECL_NAME);
         if (DECL_IS_BUILTIN(orig_tree))
             xml0("builtin");
-        xml1("location", expand_location(TAKE1(DECL_SOURCE_LOCATION)));
+        xml1("location", expand_location_cached(TAKE1(DECL_SOURCE_LOCATION)));
 #if V(6)
         xml1("location-range", DECL_LOCATION_RANGE(CONST_CAST_TREE(orig_tree)));
 #endif
@@ -2974,10 +3281,8 @@ E& operator ++(E& e)
     return e = (E)(e + 1);
 }
 
-static void dump_all()
+static void dump_globals()
 {
-    Xml root("vomitorium-dump", "version", 1);
-
     {
         Xml all_globals("globals");
 
@@ -3176,30 +3481,575 @@ static void dump_all()
         }
 #endif
     } // </globals>
+}
+
+// With -fplugin-arg-vomitorium-dump-shards, each of these gets its own
+// ${output}.NAME, with a single <vomitorium-dump><trees> and an index.
+// Trees of any other class (TREE_LIST, BLOCK, SSA_NAME, ...) stay in the
+// main output, along with everything that isn't a tree.
+enum ShardKind
+{
+    SHARD_TYPES,
+    SHARD_DECLS,
+    SHARD_EXPRS,
+    SHARD_CONSTANTS,
+    SHARD_IDENTIFIERS,
+    SHARD_COUNT,
+};
+static const char *const shard_names[SHARD_COUNT] =
+{
+    "types",
+    "decls",
+    "exprs",
+    "constants",
+    "identifiers",
+};
+struct Shard
+{
+    Stream *stream;
+    Record *root;
+    Xml *trees;
+};
+static Shard shards[SHARD_COUNT];
+
+static Stream *shard_for(const_tree t)
+{
+    // Scoped ids stay in the record that gave them out.
+    if (!shards[0].stream || !t || InternScope::active())
+        return nullptr;
+    if (TREE_CODE(t) == IDENTIFIER_NODE)
+        return shards[SHARD_IDENTIFIERS].stream;
+    switch (TREE_CODE_CLASS(TREE_CODE(t)))
+    {
+    case tcc_type:
+        return shards[SHARD_TYPES].stream;
+    case tcc_declaration:
+        return shards[SHARD_DECLS].stream;
+    case tcc_constant:
+        return shards[SHARD_CONSTANTS].stream;
+    case tcc_reference:
+    case tcc_comparison:
+    case tcc_unary:
+    case tcc_binary:
+    case tcc_statement:
+    case tcc_vl_exp:
+    case tcc_expression:
+        return shards[SHARD_EXPRS].stream;
+    case tcc_exceptional:
+        break;
+        // in lieu of default, let -Werror=switch-enum catch this
+    }
+    return nullptr;
+}
 
+// Dump one tree into its shard, or the current stream if it has none.
+static void dump_one_tree(const_tree t)
+{
+    Stream *shard = shard_for(t);
+    StreamSwitch to(shard ? shard : current_stream);
+    dump_tree(t);
+    emit_pending_strings();
+}
 
-    // Finally, dump all the top-level trees we've encountered.
+// Dump every interned tree from `from` on, and return where it stopped.
+static size_t dump_trees(size_t from)
+{
+    Xml all_trees("trees");
+    // This will add more trees as it walks them, so we can't use for-each.
+    size_t i;
+    for (i = from; i < interned_tree_list.size(); ++i)
     {
-        Xml all_trees("trees");
-        // This will add more trees as it walks them, so we can't use for-each.
-        for (size_t i = 0; i < interned_tree_list.size(); ++i)
-        {
-            dump_tree(interned_tree_list[i]);
-        }
-    } // </trees>
+        // The ids an InternScope gave out are gone once it is.
+        if (i && !interned_tree_list[i])
+            continue;
+        dump_one_tree(interned_tree_list[i]);
+    }
+    return i;
+}
 
+static void warn_incomplete()
+{
     if (incomplete_dumps)
     {
         printf("warning: %zu/%zu incomplete dumps\n", incomplete_dumps, interned_tree_list.size());
         printf("note: set a breakpoint on `dump_remaining` to help fix this\n");
     }
 }
-static void do_dump(void *, void *)
+
+static void dump_all()
+{
+    Record root("vomitorium-dump");
+
+    dump_globals();
+
+    // Finally, dump all the top-level trees we've encountered.
+    dump_trees(0);
+
+    warn_incomplete();
+}
+
+// With dump-at=finish-decl or finish-type, there's a record per tree.
+// Dumping everything each time would be quadratic, so after the first
+// record (which has the globals), each one only has the trees that are
+// new since the one before; @N still means the same thing across them.
+static size_t dump_at_tree_upto;
+
+static void do_dump(tree subject)
+{
+    if (!subject)
+    {
+        dump_all();
+        return;
+    }
+
+    Record root("vomitorium-dump");
+    if (!dump_at_tree_upto)
+        dump_globals();
+    intern(subject);
+    dump_at_tree_upto = dump_trees(dump_at_tree_upto);
+    warn_incomplete();
+}
+
+void enable_dump_v1(const char *dump_at)
+{
+    // Every dump after the first reuses ids from the ones before it.
+    root_interned_trees();
+    register_dump(dump_at, do_dump);
+}
+
+
+// Streaming: rather than one big dump, each decl and type is dumped as
+// soon as it's finished, along with whatever new trees it refers to.
+//
+// Since @N is just the intern() id, a reference to a tree that hasn't
+// been dumped yet is fine; its <tree> will come along later. The output
+// is one <vomitorium-dump> made of several <trees>, then the <globals>,
+// then a last <trees> for anything that only the globals refer to.
+// GIMPLE and RTL records can't go inside it, so it ends before each of
+// those, and a new one starts with the next tree after.
+//
+// A tree can be dumped before it's complete: a struct that was only
+// declared, or a function before its body. Those are dumped again when
+// they're finished (at finish-type, and at pre-genericize), and a later
+// <tree> for the same @N replaces the earlier one, as does its index.
+//
+// The ids have to stay valid for the whole unit, so the intern table is
+// made a GC root.
+static Record *stream_root;
+static size_t stream_dumped_upto;
+
+static void stream_open()
+{
+    if (!stream_root)
+        stream_root = new Record("vomitorium-dump");
+}
+
+static void stream_close()
+{
+    delete stream_root;
+    stream_root = nullptr;
+}
+
+static bool stream_dumped(const_tree t)
+{
+    auto it = interned_tree_ids.find(t);
+    return it != interned_tree_ids.end() && it->second < stream_dumped_upto;
+}
+
+static void stream_redump(const std::vector<const_tree>& again)
+{
+    if (again.empty())
+        return;
+    stream_open();
+    Xml trees("trees");
+    for (size_t i = 0; i < again.size(); ++i)
+        dump_one_tree(again[i]);
+}
+
+static void stream_finish_tree(void *gcc_data, void *)
+{
+    intern((tree)gcc_data);
+    stream_open();
+    stream_dumped_upto = dump_trees(stream_dumped_upto);
+}
+
+static void stream_finish_type(void *gcc_data, void *)
+{
+    const_tree type = (const_tree)gcc_data;
+    if (type && TYPE_P(type))
+    {
+        // The variants share the fields, so they were incomplete too.
+        std::vector<const_tree> again;
+        for (const_tree v = TYPE_MAIN_VARIANT(type); v; v = TYPE_NEXT_VARIANT(v))
+            if (stream_dumped(v))
+                again.push_back(v);
+        stream_redump(again);
+    }
+    stream_finish_tree(gcc_data, nullptr);
+}
+
+static void stream_pre_genericize(void *gcc_data, void *)
+{
+    const_tree fndecl = (const_tree)gcc_data;
+    if (stream_dumped(fndecl))
+        stream_redump(std::vector<const_tree>(1, fndecl));
+    stream_finish_tree(gcc_data, nullptr);
+}
+
+static void stream_finish_unit(void *, void *)
+{
+    stream_open();
+    dump_globals();
+    stream_dumped_upto = dump_trees(stream_dumped_upto);
+    stream_close();
+    warn_incomplete();
+}
+
+void enable_dump_v1_stream()
+{
+    root_interned_trees();
+
+#if V(4, 7)
+    register_callback("vomitorium", PLUGIN_FINISH_DECL, stream_finish_tree, nullptr);
+#else
+    fprintf(stderr, "Warning: vomitorium dump-stream needs PLUGIN_FINISH_DECL (GCC 4.7) to dump decls as they come\n");
+#endif
+    register_callback("vomitorium", PLUGIN_FINISH_TYPE, stream_finish_type, nullptr);
+    register_callback("vomitorium", PLUGIN_PRE_GENERICIZE, stream_pre_genericize, nullptr);
+    register_callback("vomitorium", PLUGIN_FINISH_UNIT, stream_finish_unit, nullptr);
+}
+
+
+// GIMPLE, from a pass of our own after some other pass.
+// Each function's trees follow its statements, as in streaming mode.
+//
+// SSA names and temporaries are freed once a function is done, and the
+// next one's can reuse their addresses, so their ids only mean anything
+// within the record (see InternScope). Decls and types keep the @N they
+// have in the rest of the dump. A record has the <tree>s of everything
+// first seen in it; the others are in whichever record saw them first.
+
+static void dump_gimple_seq(gimple_seq seq)
+{
+    for (gimple_stmt_iterator gsi = gsi_start(seq); !gsi_end_p(gsi); gsi_next(&gsi))
+        xemit((const_gimple_ptr)gsi_stmt(gsi));
+}
+
+static void dump_gimple_function()
+{
+    stream_close();
+    size_t from = interned_tree_list.size();
+    InternScope scope;
+    Record root("vomitorium-gimple");
+    xml1("function", (const_tree)current_function_decl);
+
+    if (cfun->cfg)
+    {
+        basic_block bb;
+        FOR_EACH_BB_FN (bb, cfun)
+        {
+            Xml bb_xml("bb", "index", bb->index);
+            dump_gimple_seq(phi_nodes(bb));
+            dump_gimple_seq(bb_seq(bb));
+        }
+    }
+    else
+    {
+        dump_gimple_seq(gimple_body(current_function_decl));
+    }
+
+    dump_trees(from);
+    warn_incomplete();
+}
+
+void enable_dump_v1_gimple(const char *after)
+{
+    register_gimple_pass_after(after, dump_gimple_function);
+}
+
+
+static void dump_rtx(const_rtx orig_rtx)
+{
+    if (!orig_rtx)
+    {
+        xml0("rtx", "id", orig_rtx);
+        return;
+    }
+    Xml rtx_xml("rtx", "id", orig_rtx);
+    rtx x = CONST_CAST_RTX(orig_rtx);
+
+    enum rtx_code code = GET_CODE(x);
+    xml1("code", GET_RTX_NAME(code));
+    xml1("mode", GET_MODE_NAME(GET_MODE(x)));
+
+#define DO_FLAG(name, FLAG)             \
+    do                                  \
+    {                                   \
+        if (RTX_FLAG(x, FLAG))          \
+            xml0(name);                 \
+    }                                   \
+    while (0)
+    DO_FLAG("jump", jump);
+    DO_FLAG("call", call);
+    DO_FLAG("unchanging", unchanging);
+    DO_FLAG("volatil", volatil);
+    DO_FLAG("in-struct", in_struct);
+    DO_FLAG("used", used);
+    DO_FLAG("frame-related", frame_related);
+    DO_FLAG("return-val", return_val);
+#undef DO_FLAG
+
+    // Operands are described by the format string in rtl.def.
+    const char *format = GET_RTX_FORMAT(code);
+    for (int i = 0; format[i]; ++i)
+    {
+        switch (format[i])
+        {
+        case 'e':
+        case 'u':
+            xml1("e", (const_rtx)XEXP(x, i));
+            break;
+        case 'E':
+        case 'V':
+            {
+                Xml vec("vec");
+                if (XVEC(x, i))
+                {
+                    int len = XVECLEN(x, i);
+                    for (int j = 0; j < len; ++j)
+                        xml1("e", (const_rtx)XVECEXP(x, i, j));
+                }
+            }
+            break;
+        case 'i':
+        case 'n':
+            xml1("i", XINT(x, i));
+            break;
+        case 'w':
+            xml1("w", XWINT(x, i));
+            break;
+        case 's':
+        case 'S':
+        case 'T':
+            if (XSTR(x, i))
+                xml1("s", (const char *)XSTR(x, i));
+            else
+                xml0("s", "null", "true");
+            break;
+        case 't':
+            xml1("t", (const_tree)XTREE(x, i));
+            break;
+        case 'B':
+            if (XBBDEF(x, i))
+                xml1("bb", XBBDEF(x, i)->index);
+            else
+                xml0("bb", "null", "true");
+            break;
+#if V(8)
+        case 'r':
+            xml1("regno", REGNO(x));
+            break;
+        case 'p':
+            xml1("p", SUBREG_BYTE(x).coeffs[0]);
+            break;
+#endif
+        default:
+            // '0' and '*' are internal to GCC.
+            break;
+        }
+    }
+}
+
+static size_t dump_rtxes(size_t from)
+{
+    Xml all_rtxes("rtxes");
+    // This will add more rtxes as it walks them, so we can't use for-each.
+    size_t i;
+    for (i = from; i < interned_rtx_list.size(); ++i)
+    {
+        dump_rtx(interned_rtx_list[i]);
+    }
+    return i;
+}
+
+// RTL, from a pass of our own after some other RTL pass.
+// rtxes and trees refer to each other, so keep going until neither
+// table grows.
+//
+// A function's insns (and its temporaries' trees) are freed once it has
+// been compiled, and their addresses reused, so each record numbers its
+// own %N from 1, and its function-local trees get @N that are only good
+// within it, as with GIMPLE. The rtx table is emptied at the start of
+// the record rather than the end, since tree dumps (through DECL_RTL)
+// can intern rtxes in between, and those may be gone by now.
+static void dump_rtl_function()
+{
+    stream_close();
+    size_t rtl_dumped_trees_upto = interned_tree_list.size();
+    InternScope scope;
+    reset_rtx_table();
+    size_t rtl_dumped_rtxes_upto = 0;
+
+    Record root("vomitorium-rtl");
+    xml1("function", (const_tree)current_function_decl);
+
+    {
+        Xml insns("insns");
+        for (auto insn = get_insns(); insn; insn = NEXT_INSN(insn))
+            xml1("insn", (const_rtx)insn);
+    }
+
+    while (rtl_dumped_rtxes_upto < interned_rtx_list.size() || rtl_dumped_trees_upto < interned_tree_list.size())
+    {
+        rtl_dumped_rtxes_upto = dump_rtxes(rtl_dumped_rtxes_upto);
+        rtl_dumped_trees_upto = dump_trees(rtl_dumped_trees_upto);
+    }
+    warn_incomplete();
+}
+
+void enable_dump_v1_rtl(const char *after)
+{
+    register_rtl_pass_after(after, dump_rtl_function);
+}
+
+
+static bool tree_span_less(const TreeSpan& a, const TreeSpan& b)
+{
+    return a.id < b.id;
+}
+
+static void write_stream_index(Stream& stream)
+{
+    OutputBuffer& buffer = *stream.buffer;
+    const std::vector<RecordSpan>& record_spans = stream.record_spans;
+    std::vector<TreeSpan>& tree_spans = stream.tree_spans;
+    char line[64];
+    int len;
+
+    size_t records_offset = buffer.tell();
+    buffer.append(INDEX_RECORDS_BEGIN, strlen(INDEX_RECORDS_BEGIN));
+    for (size_t i = 0; i < record_spans.size(); ++i)
+    {
+        const RecordSpan& span = record_spans[i];
+        len = snprintf(line, sizeof(line), INDEX_RECORD_FORMAT, span.offset, span.length, span.tag);
+        buffer.append(line, len);
+    }
+    buffer.append(INDEX_END, strlen(INDEX_END));
+
+    // By id, and only the latest dump of each.
+    std::stable_sort(tree_spans.begin(), tree_spans.end(), tree_span_less);
+    size_t spans = 0;
+    for (size_t i = 0; i < tree_spans.size(); ++i)
+    {
+        if (spans && tree_spans[spans - 1].id == tree_spans[i].id)
+            --spans;
+        tree_spans[spans++] = tree_spans[i];
+    }
+    tree_spans.resize(spans);
+
+    // Trees that were interned but never dumped are absent too.
+    size_t tree_count = interned_tree_list.size();
+    size_t trees_offset = buffer.tell();
+    if (2 * spans < tree_count)
+    {
+        len = snprintf(line, sizeof(line), INDEX_SPARSE_TREES_BEGIN_FORMAT, spans);
+        assert ((size_t)len == INDEX_SPARSE_TREES_BEGIN_SIZE);
+        buffer.append(line, len);
+        for (size_t i = 0; i < spans; ++i)
+        {
+            char *out = buffer.reserve(INDEX_SPARSE_TREE_SIZE + 1);
+            len = snprintf(out, INDEX_SPARSE_TREE_SIZE + 1, INDEX_SPARSE_TREE_FORMAT, tree_spans[i].id, tree_spans[i].offset);
+            assert (len == INDEX_SPARSE_TREE_SIZE);
+            buffer.commit(len);
+        }
+    }
+    else
+    {
+        len = snprintf(line, sizeof(line), INDEX_TREES_BEGIN_FORMAT, tree_count);
+        assert ((size_t)len == INDEX_TREES_BEGIN_SIZE);
+        buffer.append(line, len);
+        size_t next = 0;
+        for (size_t i = 0; i < tree_count; ++i)
+        {
+            size_t offset = INDEX_TREE_ABSENT;
+            if (next < spans && tree_spans[next].id == i)
+                offset = tree_spans[next++].offset;
+            char *out = buffer.reserve(INDEX_TREE_SIZE + 1);
+            len = snprintf(out, INDEX_TREE_SIZE + 1, INDEX_TREE_FORMAT, offset);
+            assert (len == INDEX_TREE_SIZE);
+            buffer.commit(len);
+        }
+    }
+    buffer.append(INDEX_END, strlen(INDEX_END));
+
+    len = snprintf(line, sizeof(line), INDEX_FOOTER_FORMAT, records_offset, trees_offset);
+    assert ((size_t)len == INDEX_FOOTER_SIZE);
+    buffer.append(line, len);
+    buffer.flush();
+}
+
+static void write_index(void *, void *)
+{
+    // Even if nothing was dumped, it should still look like XML.
+    write_stream_index(get_main_stream());
+}
+
+void enable_dump_v1_index()
+{
+    get_main_stream().index_trees = true;
+    register_callback("vomitorium", PLUGIN_FINISH, write_index, nullptr);
+}
+
+
+static void finish_shards(void *, void *)
+{
+    for (size_t i = 0; i < SHARD_COUNT; ++i)
+    {
+        Shard& shard = shards[i];
+        {
+            StreamSwitch to(shard.stream);
+            delete shard.trees;
+            delete shard.root;
+            write_stream_index(*shard.stream);
+            delete shard.stream->xml;
+        }
+        delete shard.stream->buffer;
+        delete shard.stream;
+        shard.stream = nullptr;
+    }
+}
+
+void enable_dump_v1_shards(const char *output)
+{
+    for (size_t i = 0; i < SHARD_COUNT; ++i)
+    {
+        std::string path = std::string(output) + "." + shard_names[i];
+        FILE *file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            fprintf(stderr, "Error: vomitorium unable to open output shard '%s'\n", path.c_str());
+            exit(1);
+        }
+        OutputBuffer *buffer = new OutputBuffer(file, true);
+        compress_output(buffer, path.c_str());
+        mmap_output(buffer, path.c_str());
+        Shard& shard = shards[i];
+        shard.stream = new Stream(buffer, new XmlOutput(buffer));
+        // Otherwise the shards couldn't be found again.
+        shard.stream->index_trees = true;
+        StreamSwitch to(shard.stream);
+        shard.root = new Record("vomitorium-dump");
+        shard.trees = new Xml("trees");
+    }
+    register_callback("vomitorium", PLUGIN_FINISH, finish_shards, nullptr);
+}
+
+void enable_dump_v1_string_table()
 {
-    dump_all();
+    string_table = true;
 }
 
-void enable_dump_v1()
+void enable_dump_v1_location_delta()
 {
-    register_callback("vomitorium", PLUGIN_PRE_GENERICIZE, do_dump, nullptr);
+    location_delta = true;
 }
@@ -8,14 +8,16 @@ FILE *vomitorium_output;
 static vomitorium_visitor dump_visitor;
 
 
-static void do_dump(void *, void *visitor)
+static void do_dump(tree subject)
 {
-    vomitorium_visit_all((vomitorium_visitor *)visitor);
+    if (subject)
+        vomitorium_visit(&dump_visitor, subject);
+    vomitorium_visit_all(&dump_visitor);
 }
 
-void enable_dump()
+void enable_dump(const char *dump_at)
 {
-    register_callback("vomitorium", PLUGIN_PRE_GENERICIZE, do_dump, (void *)&dump_visitor);
+    register_dump(dump_at, do_dump);
 }
 
 static vomitorium_cookie dump_visit_tree(vomitorium_visitor *self, const char *name, tree t)
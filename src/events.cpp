@@ -1,16 +1,24 @@
 #include "internal.hpp"
 
+#include <cstring>
+
+#include <algorithm>
+
+#include "clock.hpp"
+#include "trace.hpp"
 
-template<int i>
-static void simple_event_printer(void *gcc_data, void *user_data);
 
-void debug_events()
-{
 #if !V(4, 9)
 # define is_pseudo_event(evt) ((evt) == PLUGIN_PASS_MANAGER_SETUP || (evt) == PLUGIN_INFO || (evt) == PLUGIN_REGISTER_GGC_ROOTS || (evt) == PLUGIN_REGISTER_GGC_CACHES)
 #else
 # define is_pseudo_event(evt) ((evt) == PLUGIN_PASS_MANAGER_SETUP || (evt) == PLUGIN_INFO || (evt) == PLUGIN_REGISTER_GGC_ROOTS)
 #endif
+
+template<int i>
+static void simple_event_printer(void *gcc_data, void *user_data);
+
+void debug_events()
+{
 #define DEFEVENT(evt)                                                                       \
         if (!is_pseudo_event(evt))                                                          \
             register_callback("vomitorium", evt, simple_event_printer<evt>, (void *)#evt);
@@ -111,3 +119,89 @@ static void simple_event_printer(void *gcc_data, void *user_data)
         abort();
     }
 }
+
+
+// The binary version of debug_events(), for when printf() is too slow.
+// Each event just stores a record in a ring buffer; the whole thing is
+// written out at PLUGIN_FINISH, to be decoded later by bin/trace-decode.x.
+
+#define DEFEVENT(evt) #evt,
+static const char *event_names[] =
+{
+#include <plugin.def>
+};
+#undef DEFEVENT
+
+// must be a power of 2
+static const size_t trace_capacity = 1024 * 1024;
+static TraceRecord *trace_ring;
+static uint64_t trace_count;
+
+template<int i>
+static void trace_event(void *gcc_data, void *)
+{
+    TraceRecord *r = &trace_ring[trace_count++ & (trace_capacity - 1)];
+    r->time_ns = monotonic_ns();
+    r->event = i;
+    r->_pad = 0;
+    r->gcc_data = (uintptr_t)gcc_data;
+}
+
+static void write_trace(void *gcc_data, void *user_data)
+{
+    // Record this one by hand, so that it's always last.
+    trace_event<PLUGIN_FINISH>(gcc_data, user_data);
+
+    const char *path = (const char *)user_data;
+    FILE *out = fopen(path, "wb");
+    if (!out)
+    {
+        fprintf(stderr, "Error: vomitorium unable to open trace output '%s'\n", path);
+        return;
+    }
+
+    uint64_t count = trace_count < trace_capacity ? trace_count : trace_capacity;
+    uint64_t first = trace_count - count;
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.name_count = sizeof(event_names) / sizeof(event_names[0]);
+    header.record_count = count;
+    header.dropped = first;
+    // A short write (say, a full disk) would otherwise leave a trace that
+    // silently ends early.
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    for (size_t i = 0; i < header.name_count; ++i)
+    {
+        size_t len = strlen(event_names[i]) + 1;
+        ok = ok && fwrite(event_names[i], 1, len, out) == len;
+    }
+
+    // The ring may have wrapped, so write it in (up to) 2 pieces.
+    size_t start = first & (trace_capacity - 1);
+    size_t tail = std::min<uint64_t>(count, trace_capacity - start);
+    ok = ok && fwrite(&trace_ring[start], sizeof(TraceRecord), tail, out) == tail;
+    ok = ok && fwrite(&trace_ring[0], sizeof(TraceRecord), count - tail, out) == count - tail;
+
+    if (fclose(out) != 0 || !ok)
+        fprintf(stderr, "Error: vomitorium failed to write trace output '%s'\n", path);
+
+    free(trace_ring);
+    trace_ring = nullptr;
+}
+
+void enable_trace(const char *path)
+{
+    trace_ring = (TraceRecord *)calloc(trace_capacity, sizeof(TraceRecord));
+    if (!trace_ring)
+        abort();
+#define DEFEVENT(evt)                                                   \
+        if (!is_pseudo_event(evt) && (evt) != PLUGIN_FINISH)            \
+            register_callback("vomitorium", evt, trace_event<evt>, nullptr);
+#include <plugin.def>
+#undef DEFEVENT
+    register_callback("vomitorium", PLUGIN_FINISH, write_trace, (void *)path);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+// DO NOT INCLUDE ANY GCC HEADERS
+// (this is shared with readers)
+
+/*
+    Trailing index of a dump, as written with -fplugin-arg-vomitorium-index.
+
+    Each top-level element of the dump (<vomitorium-dump>,
+    <vomitorium-gimple>, <vomitorium-rtl>) is a record: it starts at the
+    beginning of a line and ends with a newline, so it can be processed
+    on its own. After the last record comes an XML comment listing them,
+    one fixed-width line each:
+
+        <!--
+        vomitorium-records
+        OFFSET LENGTH TAG
+        ...
+        -->
+
+    then the byte offset of the latest <tree> for every intern() id, in id
+    order, or all f's for ids that were never dumped:
+
+        <!--
+        vomitorium-trees COUNT
+        OFFSET
+        ...
+        -->
+
+    so tree @N is found at the offset on line N of the table. When fewer
+    than half of the ids were dumped to this file (as in a shard, which
+    only gets trees of one kind), the table instead lists just those,
+    as id and offset pairs in id order, for a binary search:
+
+        <!--
+        vomitorium-sparse-trees COUNT
+        ID OFFSET
+        ...
+        -->
+
+    Strings aren't indexed. In a dump written with
+    -fplugin-arg-vomitorium-string-table, a tree found this way may name
+    a `$N` whose <string id="$N"> came after an earlier tree of the same
+    record, so resolving it means scanning the record from its start up
+    to the end of that tree.
+
+    Last of all comes a fixed-size footer giving the offsets of the
+    records comment and of whichever tree table there is:
+
+        <!-- vomitorium-index RECORDS TREES -->
+
+    All numbers are 16 lowercase hex digits.
+*/
+
+#define INDEX_RECORDS_BEGIN "<!--\nvomitorium-records\n"
+#define INDEX_RECORD_FORMAT "%016zx %016zx %s\n"
+#define INDEX_TREES_BEGIN_FORMAT "<!--\nvomitorium-trees %016zx\n"
+#define INDEX_TREES_BEGIN_SIZE (sizeof("<!--\nvomitorium-trees \n") - 1 + 16)
+#define INDEX_TREE_FORMAT "%016zx\n"
+#define INDEX_TREE_SIZE 17
+#define INDEX_TREE_ABSENT ((size_t)-1)
+#define INDEX_SPARSE_TREES_BEGIN_FORMAT "<!--\nvomitorium-sparse-trees %016zx\n"
+#define INDEX_SPARSE_TREES_BEGIN_SIZE (sizeof("<!--\nvomitorium-sparse-trees \n") - 1 + 16)
+#define INDEX_SPARSE_TREE_FORMAT "%016zx %016zx\n"
+#define INDEX_SPARSE_TREE_SIZE 34
+#define INDEX_END "-->\n"
+#define INDEX_FOOTER_FORMAT "<!-- vomitorium-index %016zx %016zx -->\n"
+#define INDEX_FOOTER_SIZE (sizeof("<!-- vomitorium-index   -->\n") - 1 + 16 + 16)
@@ -1,11 +1,15 @@
 #include "internal.hpp"
 
 #include <cassert>
+#include <cctype>
+#include <cstdlib>
 
 #include <string>
 #include <map>
 #include <memory>
 
+#include "compress.hpp"
+
 #include "vgcc/c-family/c-common.h"
 #include "vgcc/langhooks.h"
 
@@ -19,11 +23,28 @@ static plugin_info vomitorium_info =
 
 struct Options
 {
+    const char *compress;
+    size_t compress_level;
     bool debug_events;
     bool dump;
+    const char *dump_at;
+    const char *dump_gimple_after;
+    const char *dump_rtl_after;
+    bool dump_shards;
+    bool dump_stream;
     bool hello;
+    const char *include_profile;
+    bool index;
     bool info;
+    bool location_delta;
+    const char *memory_profile;
+    bool mmap_output;
     const char *output;
+    const char *parse_profile;
+    size_t parse_profile_top;
+    const char *profile;
+    bool string_table;
+    const char *trace;
 
     Options()
     {
@@ -94,6 +115,29 @@ static std::shared_ptr<StringOptionSetter> make_option_setter(const char *Option
     return std::make_shared<StringOptionSetter>(mp);
 }
 
+class SizeOptionSetter : public PmdOptionSetter<size_t>
+{
+public:
+    template<class... A>
+    SizeOptionSetter(A&&... a) : PmdOptionSetter<size_t>(std::forward<A>(a)...) {}
+
+    virtual bool parse_option(size_t *out, const char *val) override
+    {
+        if (!val || !isdigit(val[0]))
+            return false;
+        char *end;
+        unsigned long long v = strtoull(val, &end, 10);
+        if (*end)
+            return false;
+        *out = v;
+        return true;
+    }
+};
+static std::shared_ptr<SizeOptionSetter> make_option_setter(size_t Options::*mp)
+{
+    return std::make_shared<SizeOptionSetter>(mp);
+}
+
 class OptionSetter
 {
     std::shared_ptr<AbstractOptionSetter> impl;
@@ -110,11 +154,28 @@ public:
 
 static std::map<std::string, OptionSetter> option_map =
 {
+    {"compress", &Options::compress},
+    {"compress-level", &Options::compress_level},
     {"debug_events", &Options::debug_events},
     {"dump", &Options::dump},
+    {"dump-at", &Options::dump_at},
+    {"dump-gimple-after", &Options::dump_gimple_after},
+    {"dump-rtl-after", &Options::dump_rtl_after},
+    {"dump-shards", &Options::dump_shards},
+    {"dump-stream", &Options::dump_stream},
     {"hello", &Options::hello},
+    {"include-profile", &Options::include_profile},
+    {"index", &Options::index},
     {"info", &Options::info},
+    {"location-delta", &Options::location_delta},
+    {"memory-profile", &Options::memory_profile},
+    {"mmap-output", &Options::mmap_output},
     {"output", &Options::output},
+    {"parse-profile", &Options::parse_profile},
+    {"parse-profile-top", &Options::parse_profile_top},
+    {"profile", &Options::profile},
+    {"string-table", &Options::string_table},
+    {"trace", &Options::trace},
 };
 
 
@@ -245,6 +306,29 @@ int plugin_init (struct plugin_name_args *plugin_info,
         vomitorium_output = stdout;
     }
 
+    if (options.compress)
+    {
+        // The libraries would just fail (and we'd abort) on a bad level.
+        int max_level = max_compress_level(options.compress);
+        if (max_level && options.compress_level > (size_t)max_level)
+        {
+            fprintf(stderr, "Error: vomitorium compress-level for %s must be between 1 and %d (or 0 for the default)\n", options.compress, max_level);
+            exit(1);
+        }
+        set_output_compression(options.compress, options.compress_level);
+        compress_output(&get_output_buffer(), options.output);
+    }
+    if (options.mmap_output)
+    {
+        if (options.compress)
+        {
+            fprintf(stderr, "Error: vomitorium mmap-output can't be combined with compress\n");
+            exit(1);
+        }
+        set_output_mmap();
+        mmap_output(&get_output_buffer(), options.output);
+    }
+
     if (options.hello)
         vomitorium_hello();
 
@@ -282,9 +366,75 @@ int plugin_init (struct plugin_name_args *plugin_info,
         debug_events();
     }
 
-    if (options.dump)
+    if (options.trace)
+    {
+        enable_trace(options.trace);
+    }
+
+    if (options.profile)
+    {
+        enable_profile(options.profile);
+    }
+
+    if (options.include_profile)
+    {
+        enable_include_profile(options.include_profile);
+    }
+
+    if (options.parse_profile)
+    {
+        enable_parse_profile(options.parse_profile, options.parse_profile_top);
+    }
+
+    if (options.memory_profile)
+    {
+        enable_memory_profile(options.memory_profile);
+    }
+
+    if (options.location_delta)
+    {
+        enable_dump_v1_location_delta();
+    }
+
+    if (options.string_table)
+    {
+        enable_dump_v1_string_table();
+    }
+
+    if (options.dump_shards)
+    {
+        if (!options.output)
+        {
+            fprintf(stderr, "Error: vomitorium dump-shards needs an output file to name the shards after\n");
+            exit(1);
+        }
+        enable_dump_v1_shards(options.output);
+    }
+
+    if (options.dump && options.dump_stream)
+    {
+        if (options.dump_at)
+            fprintf(stderr, "Warning: vomitorium dump-at is ignored with dump-stream\n");
+        enable_dump_v1_stream();
+    }
+    else if (options.dump)
+    {
+        enable_dump_v1(options.dump_at);
+    }
+
+    if (options.dump_gimple_after)
+    {
+        enable_dump_v1_gimple(options.dump_gimple_after);
+    }
+
+    if (options.dump_rtl_after)
+    {
+        enable_dump_v1_rtl(options.dump_rtl_after);
+    }
+
+    if (options.index)
     {
-        enable_dump_v1();
+        enable_dump_v1_index();
     }
 
     return 0;
@@ -1,15 +1,90 @@
 #include "intern.hpp"
 
+#include "vgcc/ggc.h"
 #include "vgcc/tree.h"
 
 
 std::vector<const_tree> interned_tree_list = {NULL_TREE};
 std::map<const_tree, size_t> interned_tree_ids = {{NULL_TREE, 0}};
 
+// See InternScope.
+static bool is_function_local(const_tree t)
+{
+    if (!t)
+        return false;
+    if (TREE_CODE(t) == SSA_NAME || EXPR_P(t))
+        return true;
+    return TREE_CODE(t) == VAR_DECL && DECL_ARTIFICIAL(t) && DECL_IGNORED_P(t)
+        && DECL_CONTEXT(t) && TREE_CODE(DECL_CONTEXT(t)) == FUNCTION_DECL;
+}
+
 size_t intern(const_tree t)
 {
-    auto pair = interned_tree_ids.insert(std::make_pair(t, interned_tree_ids.size()));
+    // Either way, ids come from the one list, so they never clash.
+    size_t next = interned_tree_list.size();
+    InternScope *scope = InternScope::current;
+    auto pair = scope && is_function_local(t)
+        ? scope->local_ids.insert(std::make_pair(t, next))
+        : interned_tree_ids.insert(std::make_pair(t, next));
     if (pair.second)
         interned_tree_list.push_back(t);
     return pair.first->second;
 }
+
+InternScope *InternScope::current;
+
+InternScope::InternScope() : outer(current)
+{
+    root_interned_trees();
+    current = this;
+}
+
+InternScope::~InternScope()
+{
+    current = this->outer;
+    for (auto it = this->local_ids.begin(); it != this->local_ids.end(); ++it)
+        interned_tree_list[it->second] = NULL_TREE;
+}
+
+static bool interned_trees_rooted;
+
+static void mark_interned_trees(void *, void *)
+{
+    // (gt_ggc_mx_tree_node skips the NULL_TREE of forgotten ids.)
+    for (size_t i = 1; i < interned_tree_list.size(); ++i)
+        gt_ggc_mx_tree_node(CONST_CAST_TREE(interned_tree_list[i]));
+}
+
+void root_interned_trees()
+{
+    if (interned_trees_rooted)
+        return;
+    interned_trees_rooted = true;
+    register_callback("vomitorium", PLUGIN_GGC_MARKING, mark_interned_trees, nullptr);
+}
+
+bool interned_trees_are_rooted()
+{
+    return interned_trees_rooted;
+}
+
+
+// Whoever uses these may hold on to ids for as long as they like.
+size_t vomitorium_tree_id(tree t)
+{
+    root_interned_trees();
+    return intern(t);
+}
+
+tree vomitorium_tree_by_id(size_t id)
+{
+    root_interned_trees();
+    if (id >= interned_tree_list.size())
+        return NULL_TREE;
+    return CONST_CAST_TREE(interned_tree_list[id]);
+}
+
+size_t vomitorium_tree_count()
+{
+    return interned_tree_list.size();
+}
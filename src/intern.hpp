@@ -10,10 +10,37 @@
 // TODO genericize this.
 
 
-// TODO: in order to support multiple dumps properly, this needs to be
-// registered as a GC root. Possibly switch to VEC(tree, gc)?
-// (the map is fine since it uses the same trees)
+// Not a GC root by itself: anything that keeps ids across collections
+// (e.g. a dump whose later records refer back to earlier ones) must call
+// root_interned_trees(), or a swept tree's address may be reused and get
+// the old id. (The memory profile relies on it *not* being a root.)
 extern std::vector<const_tree> interned_tree_list;
 extern std::map<const_tree, size_t> interned_tree_ids;
 
 extern size_t intern(const_tree t);
+extern void root_interned_trees();
+extern bool interned_trees_are_rooted();
+
+// While one of these is alive, trees that go away with the function
+// (SSA names, expressions and the gimplifier's temporaries) get ids of
+// their own, which are forgotten when it dies: their slots in
+// interned_tree_list become NULL_TREE, and the same address can get a
+// new id later. Everything else (decls, types, constants) is interned
+// as usual, so it keeps the @N it has in the rest of the dump; those
+// have to outlive the function, so this roots the table.
+class InternScope
+{
+    std::map<const_tree, size_t> local_ids;
+    InternScope *outer;
+    static InternScope *current;
+
+    InternScope(const InternScope&) = delete;
+    InternScope& operator = (const InternScope&) = delete;
+
+    friend size_t intern(const_tree t);
+public:
+    InternScope();
+    ~InternScope();
+
+    static bool active() { return current != nullptr; }
+};
@@ -25,6 +25,37 @@
 // don't know how to safely include headers without knowing it first.
 // (This is useful for old versions that don't define it anyway).
 
+class OutputBuffer;
+
+// Shared by the dumpers and the vomitorium_sink_* functions.
+OutputBuffer& get_output_buffer();
+// For -fplugin-arg-vomitorium-compress. The frame table for random access
+// goes to PATH.frames, if there is a path.
+void set_output_compression(const char *name, int level);
+void compress_output(OutputBuffer *buffer, const char *path);
+// For -fplugin-arg-vomitorium-mmap-output. Not with compression.
+void set_output_mmap();
+void mmap_output(OutputBuffer *buffer, const char *path);
+
 void debug_events();
-void enable_dump();
-void enable_dump_v1();
+void enable_trace(const char *path);
+void enable_profile(const char *path);
+void enable_include_profile(const char *path);
+void enable_parse_profile(const char *path, size_t top_n);
+void enable_memory_profile(const char *path);
+// `subject` is the tree that triggered the dump, if it's not a global.
+typedef void (*DumpFunction)(tree subject);
+void register_dump(const char *dump_at, DumpFunction fn);
+void enable_dump(const char *dump_at);
+void enable_dump_v1(const char *dump_at);
+void enable_dump_v1_stream();
+void enable_dump_v1_gimple(const char *after);
+void enable_dump_v1_rtl(const char *after);
+void enable_dump_v1_index();
+void enable_dump_v1_shards(const char *output);
+void enable_dump_v1_string_table();
+void enable_dump_v1_location_delta();
+
+typedef void (*PassFunction)();
+void register_gimple_pass_after(const char *after, PassFunction fn);
+void register_rtl_pass_after(const char *after, PassFunction fn);
@@ -0,0 +1,144 @@
+#include "internal.hpp"
+
+#include <unistd.h>
+
+#include <cstdio>
+
+#include <vector>
+
+#include "clock.hpp"
+#include "intern.hpp"
+
+#include "vgcc/ggc.h"
+#include "vgcc/tree.h"
+
+
+// Memory around each garbage collection, as a tagged CSV:
+//
+//     gc,N,start_ms,duration_ms,rss_before_kb,rss_after_kb,live_trees,live_bytes
+//     ...
+//     code,TREE_CODE,live_trees,live_bytes
+//
+// GCC doesn't export how many bytes GGC has allocated (ggc-page.c keeps
+// that to itself), so the process RSS has to stand in for it.
+//
+// Only interned trees are attributed, so this only says anything about
+// trees when something else (a dump, a visitor) is interning them.
+// Since the intern table is not a GC root, its entries may dangle once a
+// collection has swept; instead we keep our own list of trees that are
+// known to still be alive, and only look at those and the ones interned
+// since the last collection, which can't have been swept yet.
+// Once something roots the table (a dump that keeps ids across events,
+// or the tree id API), every interned tree survives, and the counts say
+// more about the dump than about the compiler; that gets a warning.
+
+static FILE *memory_file;
+static uint64_t memory_start_ns;
+static long memory_page_kb;
+
+static size_t memory_collections;
+static bool memory_warned_rooted;
+static uint64_t memory_gc_start_ns;
+static long memory_rss_before_kb;
+
+static std::vector<const_tree> memory_live;
+static size_t memory_interned_upto = 1; // skip NULL_TREE
+static size_t memory_live_bytes;
+static size_t memory_code_trees[MAX_TREE_CODES];
+static size_t memory_code_bytes[MAX_TREE_CODES];
+
+static long memory_rss_kb()
+{
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return -1;
+    long size, resident;
+    int n = fscanf(statm, "%ld %ld", &size, &resident);
+    fclose(statm);
+    if (n != 2)
+        return -1;
+    return resident * memory_page_kb;
+}
+
+static void memory_ggc_start(void *, void *)
+{
+    memory_gc_start_ns = monotonic_ns();
+    memory_rss_before_kb = memory_rss_kb();
+}
+
+// Marking is complete, but nothing has been swept yet.
+static void memory_ggc_marking(void *, void *)
+{
+    if (interned_trees_are_rooted() && !memory_warned_rooted)
+    {
+        memory_warned_rooted = true;
+        fprintf(stderr, "Warning: vomitorium memory-profile live trees include ones that only the dump is keeping alive\n");
+    }
+    for (; memory_interned_upto < interned_tree_list.size(); ++memory_interned_upto)
+        if (interned_tree_list[memory_interned_upto])
+            memory_live.push_back(interned_tree_list[memory_interned_upto]);
+
+    memory_live_bytes = 0;
+    for (size_t i = 0; i < MAX_TREE_CODES; ++i)
+    {
+        memory_code_trees[i] = 0;
+        memory_code_bytes[i] = 0;
+    }
+
+    size_t keep = 0;
+    for (size_t i = 0; i < memory_live.size(); ++i)
+    {
+        const_tree t = memory_live[i];
+        if (!ggc_marked_p(t))
+            continue;
+        memory_live[keep++] = t;
+
+        size_t size = tree_size(t);
+        memory_live_bytes += size;
+        memory_code_trees[TREE_CODE(t)]++;
+        memory_code_bytes[TREE_CODE(t)] += size;
+    }
+    memory_live.resize(keep);
+}
+
+static void memory_ggc_end(void *, void *)
+{
+    uint64_t now = monotonic_ns();
+    long rss_after_kb = memory_rss_kb();
+    fprintf(memory_file, "gc,%zu,%.3f,%.3f,%ld,%ld,%zu,%zu\n",
+            memory_collections++,
+            (memory_gc_start_ns - memory_start_ns) / 1e6,
+            (now - memory_gc_start_ns) / 1e6,
+            memory_rss_before_kb, rss_after_kb,
+            memory_live.size(), memory_live_bytes);
+}
+
+static void memory_finish(void *, void *user_data)
+{
+    // As of the last collection; anything since then may be garbage.
+    for (size_t i = 0; i < MAX_TREE_CODES; ++i)
+    {
+        if (!memory_code_trees[i])
+            continue;
+        fprintf(memory_file, "code,%s,%zu,%zu\n", get_tree_code_name((enum tree_code)i), memory_code_trees[i], memory_code_bytes[i]);
+    }
+    if (fclose(memory_file) != 0)
+        fprintf(stderr, "Error: vomitorium failed to write memory profile output '%s'\n", (const char *)user_data);
+    memory_file = nullptr;
+}
+
+void enable_memory_profile(const char *path)
+{
+    if (!(memory_file = fopen(path, "w")))
+    {
+        fprintf(stderr, "Error: vomitorium unable to open memory profile output '%s'\n", path);
+        exit(1);
+    }
+    memory_start_ns = monotonic_ns();
+    memory_page_kb = sysconf(_SC_PAGESIZE) / 1024;
+
+    register_callback("vomitorium", PLUGIN_GGC_START, memory_ggc_start, nullptr);
+    register_callback("vomitorium", PLUGIN_GGC_MARKING, memory_ggc_marking, nullptr);
+    register_callback("vomitorium", PLUGIN_GGC_END, memory_ggc_end, nullptr);
+    register_callback("vomitorium", PLUGIN_FINISH, memory_finish, (void *)path);
+}
@@ -0,0 +1,77 @@
+#include "internal.hpp"
+
+#include <cstring>
+
+#include "vgcc/context.h"
+#include "vgcc/function.h"
+#include "vgcc/tree-pass.h"
+
+
+// Glue for running our own code as a GCC pass, after some existing pass.
+//
+// Passes became C++ classes in GCC 4.9, and lost has_gate/has_execute
+// in GCC 5. Before that, they were C structs; nobody has asked for those.
+
+#if V(4, 9)
+template<class Base>
+class VomitoriumPass : public Base
+{
+    PassFunction fn;
+public:
+    VomitoriumPass(const pass_data& data, PassFunction f) : Base(data, g), fn(f) {}
+
+#if V(5)
+    virtual unsigned int execute(function *) override
+#else
+    virtual unsigned int execute() override
+#endif
+    {
+        this->fn();
+        return 0;
+    }
+};
+
+template<class Base>
+static void add_vomitorium_pass(opt_pass_type type, const char *name, const char *after, PassFunction fn)
+{
+    // Both of these must live as long as the pass manager does.
+    pass_data *data = new pass_data;
+    memset(data, 0, sizeof(*data));
+    data->type = type;
+    data->name = name;
+#if !V(5)
+    data->has_gate = false;
+    data->has_execute = true;
+#endif
+    data->tv_id = TV_NONE;
+
+    register_pass_info info;
+    info.pass = new VomitoriumPass<Base>(*data, fn);
+    info.reference_pass_name = after;
+    info.ref_pass_instance_number = 1;
+    info.pos_op = PASS_POS_INSERT_AFTER;
+    register_callback("vomitorium", PLUGIN_PASS_MANAGER_SETUP, nullptr, &info);
+}
+#endif
+
+void register_gimple_pass_after(const char *after, PassFunction fn)
+{
+#if V(4, 9)
+    add_vomitorium_pass<gimple_opt_pass>(GIMPLE_PASS, "vomitorium-gimple", after, fn);
+#else
+    (void)after;
+    (void)fn;
+    fprintf(stderr, "Warning: vomitorium can only add passes for GCC 4.9 and later\n");
+#endif
+}
+
+void register_rtl_pass_after(const char *after, PassFunction fn)
+{
+#if V(4, 9)
+    add_vomitorium_pass<rtl_opt_pass>(RTL_PASS, "vomitorium-rtl", after, fn);
+#else
+    (void)after;
+    (void)fn;
+    fprintf(stderr, "Warning: vomitorium can only add passes for GCC 4.9 and later\n");
+#endif
+}
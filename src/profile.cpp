@@ -0,0 +1,455 @@
+#include "internal.hpp"
+
+#include <unistd.h>
+
+#include <cstring>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "clock.hpp"
+
+#include "vgcc/function.h"
+#include "vgcc/input.h"
+#include "vgcc/langhooks.h"
+#include "vgcc/tree-pass.h"
+#include "vgcc/tree.h"
+
+
+// Per-pass compile time, written in Chrome's trace-event JSON format
+// (load it in chrome://tracing or Perfetto).
+//
+// GCC tells us when a pass starts, but not when it ends, so a pass is
+// considered to last until the next pass starts or anything else happens.
+// Nested passes therefore show up one after another, not nested.
+
+static FILE *profile_file;
+static uint64_t profile_start_ns;
+static bool profile_need_comma;
+
+static const char *current_pass;
+static std::string current_pass_function;
+static uint64_t current_pass_start_ns;
+
+static void profile_json_string(const char *s)
+{
+    putc('"', profile_file);
+    for (; *s; ++s)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(profile_file, "\\%c", c);
+        else if (c < ' ')
+            fprintf(profile_file, "\\u%04x", c);
+        else
+            putc(c, profile_file);
+    }
+    putc('"', profile_file);
+}
+
+// `function` may be NULL, and `end_ns` is only used for complete ("X") events.
+static void profile_emit(char phase, const char *category, const char *name, const char *function, uint64_t start_ns, uint64_t end_ns)
+{
+    fputs(profile_need_comma ? ",\n" : "\n", profile_file);
+    profile_need_comma = true;
+
+    fputs("{\"name\":", profile_file);
+    profile_json_string(name);
+    fputs(",\"cat\":", profile_file);
+    profile_json_string(category);
+    fprintf(profile_file, ",\"ph\":\"%c\",\"pid\":%ld,\"tid\":1,\"ts\":%.3f", phase, (long)getpid(), (start_ns - profile_start_ns) / 1e3);
+    if (phase == 'X')
+        fprintf(profile_file, ",\"dur\":%.3f", (end_ns - start_ns) / 1e3);
+    if (function)
+    {
+        fputs(",\"args\":{\"function\":", profile_file);
+        profile_json_string(function);
+        putc('}', profile_file);
+    }
+    putc('}', profile_file);
+}
+
+static void end_current_pass(uint64_t now)
+{
+    if (!current_pass)
+        return;
+    profile_emit('X', "pass", current_pass, current_pass_function.c_str(), current_pass_start_ns, now);
+    current_pass = nullptr;
+}
+
+static void profile_pass_execution(void *gcc_data, void *)
+{
+    uint64_t now = monotonic_ns();
+    end_current_pass(now);
+
+    const opt_pass *pass = (const opt_pass *)gcc_data;
+    current_pass = pass->name ? pass->name : "(unnamed)";
+    current_pass_function = current_function_name();
+    current_pass_start_ns = now;
+}
+
+// user_data is the name of the span.
+static void profile_span_begin(void *, void *user_data)
+{
+    uint64_t now = monotonic_ns();
+    end_current_pass(now);
+    profile_emit('B', "passes", (const char *)user_data, cfun ? current_function_name() : nullptr, now, now);
+}
+
+static void profile_span_end(void *, void *user_data)
+{
+    uint64_t now = monotonic_ns();
+    end_current_pass(now);
+    profile_emit('E', "passes", (const char *)user_data, nullptr, now, now);
+}
+
+static void profile_finish(void *, void *user_data)
+{
+    end_current_pass(monotonic_ns());
+    fputs("\n]}\n", profile_file);
+    if (fclose(profile_file) != 0)
+        fprintf(stderr, "Error: vomitorium failed to write profile output '%s'\n", (const char *)user_data);
+    profile_file = nullptr;
+}
+
+void enable_profile(const char *path)
+{
+    if (!(profile_file = fopen(path, "w")))
+    {
+        fprintf(stderr, "Error: vomitorium unable to open profile output '%s'\n", path);
+        exit(1);
+    }
+    profile_start_ns = monotonic_ns();
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", profile_file);
+
+    register_callback("vomitorium", PLUGIN_PASS_EXECUTION, profile_pass_execution, nullptr);
+    register_callback("vomitorium", PLUGIN_ALL_PASSES_START, profile_span_begin, (void *)"all_passes");
+    register_callback("vomitorium", PLUGIN_ALL_PASSES_END, profile_span_end, (void *)"all_passes");
+    register_callback("vomitorium", PLUGIN_EARLY_GIMPLE_PASSES_START, profile_span_begin, (void *)"early_gimple_passes");
+    register_callback("vomitorium", PLUGIN_EARLY_GIMPLE_PASSES_END, profile_span_end, (void *)"early_gimple_passes");
+    register_callback("vomitorium", PLUGIN_ALL_IPA_PASSES_START, profile_span_begin, (void *)"all_ipa_passes");
+    register_callback("vomitorium", PLUGIN_ALL_IPA_PASSES_END, profile_span_end, (void *)"all_ipa_passes");
+    register_callback("vomitorium", PLUGIN_FINISH, profile_finish, (void *)path);
+}
+
+
+#if V(4, 9)
+// Parse time per header.
+//
+// GCC tells us when a file is entered (PLUGIN_INCLUDE_FILE), but not when
+// it is left, so every so often we look at the last line map to find out
+// which file the preprocessor is in now, and close everything above it.
+//
+// Decls and types are counted by where they were written, not by which
+// file was open when they were finished: cc1plus lexes the whole unit
+// before parsing any of it, so for C++ every tree would land on the main
+// file. For the same reason, C++ header times only measure lexing.
+
+struct IncludeFrame
+{
+    const char *file;
+    uint64_t start_ns;
+    uint64_t child_ns;
+};
+
+struct IncludeStats
+{
+    uint64_t total_ns;
+    uint64_t self_ns;
+    size_t count;
+    size_t decls;
+    size_t types;
+};
+
+static const char *include_unit_name = "(unknown)";
+static std::vector<IncludeFrame> include_stack;
+static std::map<std::string, IncludeStats> include_stats;
+
+static void include_pop(uint64_t now)
+{
+    IncludeFrame frame = include_stack.back();
+    include_stack.pop_back();
+
+    uint64_t total = now - frame.start_ns;
+    IncludeStats& stats = include_stats[frame.file];
+    stats.total_ns += total;
+    stats.self_ns += total - frame.child_ns;
+    stats.count++;
+
+    if (!include_stack.empty())
+        include_stack.back().child_ns += total;
+}
+
+// Close everything that was included from `file`, but not `file` itself.
+// If we don't know about `file` at all, don't guess.
+static void include_pop_above(const char *file, uint64_t now)
+{
+    size_t keep = include_stack.size();
+    while (keep && strcmp(include_stack[keep - 1].file, file) != 0)
+        keep--;
+    if (!keep)
+        return;
+    while (include_stack.size() > keep)
+        include_pop(now);
+}
+
+static void include_sync(uint64_t now)
+{
+    auto map = LINEMAPS_LAST_ORDINARY_MAP(line_table);
+    if (map)
+        include_pop_above(ORDINARY_MAP_FILE_NAME(map), now);
+}
+
+static void include_file(void *gcc_data, void *)
+{
+    uint64_t now = monotonic_ns();
+    // This is also called for the main file, and for #line.
+    auto map = LINEMAPS_LAST_ORDINARY_MAP(line_table);
+    if (map->reason == LC_RENAME)
+    {
+        // The same file under another name, so it replaces the file's
+        // frame rather than nesting inside it.
+        size_t used = LINEMAPS_ORDINARY_USED(line_table);
+        if (used >= 2)
+        {
+            const char *old_name = ORDINARY_MAP_FILE_NAME(LINEMAPS_ORDINARY_MAP_AT(line_table, used - 2));
+            include_pop_above(old_name, now);
+            if (!include_stack.empty() && strcmp(include_stack.back().file, old_name) == 0)
+                include_pop(now);
+        }
+        if (MAIN_FILE_P(map) && ((const char *)gcc_data)[0] != '<')
+            include_unit_name = (const char *)gcc_data;
+    }
+    else if (MAIN_FILE_P(map))
+    {
+        while (!include_stack.empty())
+            include_pop(now);
+        // skip <built-in> and <command-line>
+        if (((const char *)gcc_data)[0] != '<')
+            include_unit_name = (const char *)gcc_data;
+    }
+    else
+    {
+        include_pop_above(ORDINARY_MAP_FILE_NAME(INCLUDED_FROM(line_table, map)), now);
+    }
+
+    IncludeFrame frame = {(const char *)gcc_data, now, 0};
+    include_stack.push_back(frame);
+}
+
+// Returns nullptr for builtins, which have no file.
+static IncludeStats *include_stats_at(location_t loc)
+{
+    // Trees tend to come in runs from the same file, and the line maps
+    // keep the names alive, so the last lookup is usually good enough.
+    static const char *last_file;
+    static IncludeStats *last_stats;
+
+    const char *file = LOCATION_FILE(loc);
+    if (!file)
+        return nullptr;
+    if (file != last_file)
+    {
+        last_file = file;
+        last_stats = &include_stats[file];
+    }
+    return last_stats;
+}
+
+static void include_finish_decl(void *gcc_data, void *)
+{
+    include_sync(monotonic_ns());
+    tree decl = (tree)gcc_data;
+    if (!decl || !DECL_P(decl))
+        return;
+    IncludeStats *stats = include_stats_at(DECL_SOURCE_LOCATION(decl));
+    if (stats)
+        stats->decls++;
+}
+
+static void include_finish_type(void *gcc_data, void *)
+{
+    include_sync(monotonic_ns());
+    tree type = (tree)gcc_data;
+    if (!type || !TYPE_P(type))
+        return;
+    // In C, TYPE_NAME is just an identifier, but both have a stub decl.
+    tree decl = TYPE_STUB_DECL(type);
+    if (!decl && TYPE_NAME(type) && TREE_CODE(TYPE_NAME(type)) == TYPE_DECL)
+        decl = TYPE_NAME(type);
+    if (!decl)
+        return;
+    IncludeStats *stats = include_stats_at(DECL_SOURCE_LOCATION(decl));
+    if (stats)
+        stats->types++;
+}
+
+static bool by_total_desc(const std::pair<std::string, IncludeStats>& a, const std::pair<std::string, IncludeStats>& b)
+{
+    return a.second.total_ns > b.second.total_ns;
+}
+
+static void include_finish_unit(void *, void *user_data)
+{
+    uint64_t now = monotonic_ns();
+    while (!include_stack.empty())
+        include_pop(now);
+
+    const char *path = (const char *)user_data;
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        fprintf(stderr, "Error: vomitorium unable to open include profile output '%s'\n", path);
+        return;
+    }
+
+    std::vector<std::pair<std::string, IncludeStats>> sorted(include_stats.begin(), include_stats.end());
+    std::sort(sorted.begin(), sorted.end(), by_total_desc);
+
+    // Tab-separated, so that reports from a whole build can be merged.
+    fprintf(out, "# translation unit: %s\n", include_unit_name);
+    fprintf(out, "# total_ms\tself_ms\tcount\tdecls\ttypes\tfile\n");
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        const IncludeStats& stats = sorted[i].second;
+        fprintf(out, "%.3f\t%.3f\t%zu\t%zu\t%zu\t%s\n", stats.total_ns / 1e6, stats.self_ns / 1e6, stats.count, stats.decls, stats.types, sorted[i].first.c_str());
+    }
+    if (fclose(out) != 0)
+        fprintf(stderr, "Error: vomitorium failed to write include profile output '%s'\n", path);
+}
+#endif
+
+void enable_include_profile(const char *path)
+{
+#if V(4, 9)
+    register_callback("vomitorium", PLUGIN_INCLUDE_FILE, include_file, nullptr);
+    register_callback("vomitorium", PLUGIN_FINISH_DECL, include_finish_decl, nullptr);
+    register_callback("vomitorium", PLUGIN_FINISH_TYPE, include_finish_type, nullptr);
+    register_callback("vomitorium", PLUGIN_FINISH_UNIT, include_finish_unit, (void *)path);
+#else
+    (void)path;
+    fprintf(stderr, "Warning: vomitorium include-profile needs PLUGIN_INCLUDE_FILE (GCC 4.9)\n");
+#endif
+}
+
+
+#if V(6)
+// Parse time per function body, from PLUGIN_START_PARSE_FUNCTION to
+// PLUGIN_FINISH_PARSE_FUNCTION. These can nest (e.g. C++ lambdas), in
+// which case the outer function's time includes the inner one's.
+//
+// As with headers, trees are approximated by the decls and types finished.
+
+struct ParseFrame
+{
+    uint64_t start_ns;
+    size_t decls;
+    size_t types;
+};
+
+struct ParseStats
+{
+    uint64_t time_ns;
+    size_t decls;
+    size_t types;
+    std::string location;
+    std::string name;
+};
+
+static std::vector<ParseFrame> parse_stack;
+static std::vector<ParseStats> parse_stats;
+static size_t parse_top_n;
+
+static void parse_start_function(void *, void *)
+{
+    ParseFrame frame = {monotonic_ns(), 0, 0};
+    parse_stack.push_back(frame);
+}
+
+static void parse_finish_function(void *gcc_data, void *)
+{
+    uint64_t now = monotonic_ns();
+    if (parse_stack.empty())
+        return;
+    ParseFrame frame = parse_stack.back();
+    parse_stack.pop_back();
+    // Not mutually exclusive, unlike the include profile.
+    if (!parse_stack.empty())
+    {
+        parse_stack.back().decls += frame.decls;
+        parse_stack.back().types += frame.types;
+    }
+
+    tree decl = (tree)gcc_data;
+    expanded_location loc = expand_location(DECL_SOURCE_LOCATION(decl));
+    char loc_buf[32];
+    snprintf(loc_buf, sizeof(loc_buf), ":%d:%d", loc.line, loc.column);
+
+    ParseStats stats;
+    stats.time_ns = now - frame.start_ns;
+    stats.decls = frame.decls;
+    stats.types = frame.types;
+    stats.location = std::string(loc.file ? loc.file : "(null)") + loc_buf;
+    stats.name = lang_hooks.decl_printable_name(decl, 2);
+    parse_stats.push_back(stats);
+}
+
+static void parse_finish_decl(void *, void *)
+{
+    if (!parse_stack.empty())
+        parse_stack.back().decls++;
+}
+
+static void parse_finish_type(void *, void *)
+{
+    if (!parse_stack.empty())
+        parse_stack.back().types++;
+}
+
+static bool by_time_desc(const ParseStats& a, const ParseStats& b)
+{
+    return a.time_ns > b.time_ns;
+}
+
+static void parse_finish_unit(void *, void *user_data)
+{
+    const char *path = (const char *)user_data;
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        fprintf(stderr, "Error: vomitorium unable to open parse profile output '%s'\n", path);
+        return;
+    }
+
+    size_t n = std::min(parse_top_n, parse_stats.size());
+    std::partial_sort(parse_stats.begin(), parse_stats.begin() + n, parse_stats.end(), by_time_desc);
+
+    fprintf(out, "# %zu slowest of %zu function bodies\n", n, parse_stats.size());
+    fprintf(out, "# ms\tdecls\ttypes\tlocation\tfunction\n");
+    for (size_t i = 0; i < n; ++i)
+    {
+        const ParseStats& stats = parse_stats[i];
+        fprintf(out, "%.3f\t%zu\t%zu\t%s\t%s\n", stats.time_ns / 1e6, stats.decls, stats.types, stats.location.c_str(), stats.name.c_str());
+    }
+    if (fclose(out) != 0)
+        fprintf(stderr, "Error: vomitorium failed to write parse profile output '%s'\n", path);
+}
+#endif
+
+void enable_parse_profile(const char *path, size_t top_n)
+{
+#if V(6)
+    parse_top_n = top_n ? top_n : 20;
+    register_callback("vomitorium", PLUGIN_START_PARSE_FUNCTION, parse_start_function, nullptr);
+    register_callback("vomitorium", PLUGIN_FINISH_PARSE_FUNCTION, parse_finish_function, nullptr);
+    register_callback("vomitorium", PLUGIN_FINISH_DECL, parse_finish_decl, nullptr);
+    register_callback("vomitorium", PLUGIN_FINISH_TYPE, parse_finish_type, nullptr);
+    register_callback("vomitorium", PLUGIN_FINISH_UNIT, parse_finish_unit, (void *)path);
+#else
+    (void)path;
+    (void)top_n;
+    fprintf(stderr, "Warning: vomitorium parse-profile needs PLUGIN_START_PARSE_FUNCTION (GCC 6)\n");
+#endif
+}
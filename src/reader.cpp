@@ -0,0 +1,766 @@
+// The dump reader library; see vomitorium-reader.h.
+// DO NOT INCLUDE ANY GCC HEADERS
+
+#include "vomitorium-reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+#include <vector>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#include "index.hpp"
+
+
+struct vomitorium_reader
+{
+    const char *data;
+    size_t size;
+
+    bool has_index;
+    bool have_records;
+    std::vector<vomitorium_record> records;
+    // Points into the mapping, INDEX_TREE_SIZE bytes per id, or if
+    // sparse, INDEX_SPARSE_TREE_SIZE bytes per entry.
+    const char *tree_table;
+    size_t tree_count;
+    bool sparse_trees;
+    size_t tree_entries;
+};
+
+
+static vomitorium_string_view make_view(const char *data, size_t len)
+{
+    vomitorium_string_view view = {data, len};
+    return view;
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static bool is_name_char(char c)
+{
+    return c != '>' && c != '/' && c != '=' && !is_space(c);
+}
+
+static const char *find(const char *p, const char *end, const char *s, size_t len)
+{
+    while (true)
+    {
+        p = (const char *)memchr(p, s[0], end - p);
+        if (!p || (size_t)(end - p) < len)
+            return NULL;
+        if (memcmp(p, s, len) == 0)
+            return p;
+        ++p;
+    }
+}
+
+// Fixed-width hex, as written by the index.
+static bool parse_hex(const char *p, size_t *out)
+{
+    size_t v = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        char c = p[i];
+        if ('0' <= c && c <= '9')
+            v = v << 4 | (c - '0');
+        else if ('a' <= c && c <= 'f')
+            v = v << 4 | (c - 'a' + 10);
+        else
+            return false;
+    }
+    *out = v;
+    return true;
+}
+
+
+// The next '<', '>', '"' or '&' at or after `p`, or `end` if there is none.
+// These are the only bytes that XmlOutput treats specially, so everything
+// else can be skipped 16 at a time.
+static const char *find_special(const char *p, const char *end)
+{
+#ifdef __SSE2__
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i amp = _mm_set1_epi8('&');
+    while (end - p >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        __m128i hits = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, lt), _mm_cmpeq_epi8(chunk, gt)),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, quot), _mm_cmpeq_epi8(chunk, amp)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    for (; p < end; ++p)
+    {
+        switch (*p)
+        {
+        case '<':
+        case '>':
+        case '"':
+        case '&':
+            return p;
+        }
+    }
+    return end;
+}
+
+
+struct vomitorium_tokens
+{
+    const char *p;
+    const char *end;
+    // Stop after the first element closes, instead of at the end.
+    bool single;
+    // Part of a bigger document: elements may close that weren't opened.
+    bool fragment;
+    bool done;
+    bool error;
+    size_t depth;
+    // A self-closing tag still owes an END token.
+    bool pending_end;
+    vomitorium_string_view pending_tag;
+
+    vomitorium_tokens(const char *begin, const char *e, bool s, bool f)
+    : p(begin)
+    , end(e)
+    , single(s)
+    , fragment(f)
+    , done(false)
+    , error(false)
+    , depth(0)
+    , pending_end(false)
+    {
+        this->pending_tag = make_view(begin, 0);
+    }
+
+    // Returns false at the end, or at the first error.
+    bool next(vomitorium_token *token);
+    void emit_none(vomitorium_token *token)
+    {
+        this->emit(token, VOMITORIUM_TOKEN_NONE, make_view(this->p, 0));
+    }
+    // Whether everything was consumed properly.
+    bool complete() const
+    {
+        if (this->fragment)
+            return !this->error;
+        return !this->error && !this->depth && (this->done || !this->single);
+    }
+private:
+    bool fail()
+    {
+        this->error = true;
+        return false;
+    }
+    void emit(vomitorium_token *token, vomitorium_token_kind kind, vomitorium_string_view tag);
+    bool text(vomitorium_token *token);
+    bool end_tag(vomitorium_token *token);
+    bool start_tag(vomitorium_token *token);
+};
+
+void vomitorium_tokens::emit(vomitorium_token *token, vomitorium_token_kind kind, vomitorium_string_view tag)
+{
+    token->kind = kind;
+    token->depth = this->depth;
+    token->tag = tag;
+    token->attr = make_view(tag.data + tag.len, 0);
+    token->value = token->attr;
+    token->text = token->attr;
+}
+
+bool vomitorium_tokens::next(vomitorium_token *token)
+{
+    if (this->pending_end)
+    {
+        this->pending_end = false;
+        this->depth--;
+        this->emit(token, VOMITORIUM_TOKEN_END, this->pending_tag);
+        if (this->single && !this->depth)
+            this->done = true;
+        return true;
+    }
+    if (this->done || this->error)
+        return false;
+
+    while (this->p < this->end)
+    {
+        const char *at = this->p;
+        if (*at != '<')
+        {
+            if (this->text(token))
+                return true;
+            if (this->error)
+                return false;
+            continue;
+        }
+        if (this->end - at >= 4 && memcmp(at, "<!--", 4) == 0)
+        {
+            const char *q = find(at, this->end, "-->", 3);
+            if (!q)
+                return this->fail();
+            this->p = q + 3;
+            continue;
+        }
+        if (this->end - at >= 2 && at[1] == '?')
+        {
+            const char *q = find(at, this->end, "?>", 2);
+            if (!q)
+                return this->fail();
+            this->p = q + 2;
+            continue;
+        }
+        if (this->end - at >= 2 && at[1] == '/')
+            return this->end_tag(token);
+        return this->start_tag(token);
+    }
+    if (this->depth && !this->fragment)
+        return this->fail();
+    return false;
+}
+
+// Returns false, without an error, for text that isn't reported.
+bool vomitorium_tokens::text(vomitorium_token *token)
+{
+    const char *start = this->p;
+    const char *q = find_special(start, this->end);
+    while (q < this->end && *q != '<')
+        q = find_special(q + 1, this->end);
+    this->p = q;
+
+    // Indentation always follows a newline; real text never has one.
+    bool blank = true;
+    for (const char *s = start; s < q && blank; ++s)
+        blank = is_space(*s);
+    if (blank && memchr(start, '\n', q - start))
+        return false;
+    if (!this->depth && !this->fragment)
+    {
+        if (!blank)
+            this->fail();
+        return false;
+    }
+    if (blank && !this->depth)
+        return false;
+    this->emit(token, VOMITORIUM_TOKEN_TEXT, make_view(start, 0));
+    token->depth = this->depth ? this->depth - 1 : 0;
+    token->text = make_view(start, q - start);
+    return true;
+}
+
+bool vomitorium_tokens::end_tag(vomitorium_token *token)
+{
+    const char *name = this->p + 2;
+    const char *q = find_special(name, this->end);
+    if (q == this->end || *q != '>' || (!this->depth && !this->fragment))
+        return this->fail();
+    this->p = q + 1;
+    if (this->depth)
+        this->depth--;
+    this->emit(token, VOMITORIUM_TOKEN_END, make_view(name, q - name));
+    if (this->single && !this->depth)
+        this->done = true;
+    return true;
+}
+
+bool vomitorium_tokens::start_tag(vomitorium_token *token)
+{
+    const char *name = this->p + 1;
+    const char *q = name;
+    while (q < this->end && is_name_char(*q))
+        ++q;
+    vomitorium_string_view tag = make_view(name, q - name);
+    vomitorium_string_view attr = make_view(q, 0);
+    vomitorium_string_view value = make_view(q, 0);
+
+    bool first = true;
+    while (true)
+    {
+        while (q < this->end && is_space(*q))
+            ++q;
+        if (q == this->end)
+            return this->fail();
+        if (*q == '>' || *q == '/')
+            break;
+
+        const char *a = q;
+        while (q < this->end && is_name_char(*q))
+            ++q;
+        if (this->end - q < 2 || q[0] != '=' || q[1] != '"')
+            return this->fail();
+        const char *v = q + 2;
+        const char *close = find_special(v, this->end);
+        while (close < this->end && *close == '&')
+            close = find_special(close + 1, this->end);
+        if (close == this->end || *close != '"')
+            return this->fail();
+        if (first)
+        {
+            attr = make_view(a, q - a);
+            value = make_view(v, close - v);
+            first = false;
+        }
+        q = close + 1;
+    }
+
+    if (*q == '/')
+    {
+        ++q;
+        if (q == this->end || *q != '>')
+            return this->fail();
+        this->pending_end = true;
+        this->pending_tag = tag;
+    }
+    this->p = q + 1;
+    this->emit(token, VOMITORIUM_TOKEN_START, tag);
+    token->attr = attr;
+    token->value = value;
+    this->depth++;
+    return true;
+}
+
+
+// The SAX interface is just a loop over the tokens.
+static bool dispatch(vomitorium_tokens *tokens, vomitorium_reader_handler *handler)
+{
+    auto on_start = VOMITORIUM_READER_HANDLER_GET_FIELD(handler, start);
+    auto on_text = VOMITORIUM_READER_HANDLER_GET_FIELD(handler, text);
+    auto on_end = VOMITORIUM_READER_HANDLER_GET_FIELD(handler, end);
+
+    vomitorium_token token;
+    vomitorium_token_init(&token);
+    while (tokens->next(&token))
+    {
+        bool ok = true;
+        switch (token.kind)
+        {
+        case VOMITORIUM_TOKEN_START:
+            ok = !on_start || on_start(handler, token.tag, token.attr, token.value);
+            break;
+        case VOMITORIUM_TOKEN_TEXT:
+            ok = !on_text || on_text(handler, token.text);
+            break;
+        case VOMITORIUM_TOKEN_END:
+            ok = !on_end || on_end(handler, token.tag);
+            break;
+        case VOMITORIUM_TOKEN_NONE:
+            abort();
+        }
+        if (!ok)
+            return false;
+    }
+    return tokens->complete();
+}
+
+
+static void read_index(vomitorium_reader *reader)
+{
+    const char *data = reader->data;
+    size_t size = reader->size;
+    if (size < INDEX_FOOTER_SIZE)
+        return;
+    const char *footer = data + size - INDEX_FOOTER_SIZE;
+    static const char footer_start[] = "<!-- vomitorium-index ";
+    if (memcmp(footer, footer_start, strlen(footer_start)) != 0)
+        return;
+
+    size_t records_offset, trees_offset;
+    const char *numbers = footer + strlen(footer_start);
+    if (!parse_hex(numbers, &records_offset) || !parse_hex(numbers + 17, &trees_offset))
+        return;
+    if (records_offset > trees_offset || trees_offset + INDEX_TREES_BEGIN_SIZE > size - INDEX_FOOTER_SIZE)
+        return;
+
+    // Records: "OFFSET LENGTH TAG\n" until the end of the comment.
+    std::vector<vomitorium_record> records;
+    const char *p = data + records_offset + strlen(INDEX_RECORDS_BEGIN);
+    const char *records_end = data + trees_offset;
+    while (p < records_end && *p != '-')
+    {
+        vomitorium_record record;
+        vomitorium_record_init(&record);
+        if (records_end - p < 34 || !parse_hex(p, &record.offset) || !parse_hex(p + 17, &record.length))
+            return;
+        const char *tag = p + 34;
+        const char *nl = (const char *)memchr(tag, '\n', records_end - tag);
+        if (!nl || record.offset > size || record.length > size - record.offset)
+            return;
+        record.tag = make_view(tag, nl - tag);
+        records.push_back(record);
+        p = nl + 1;
+    }
+
+    size_t tree_count, entries;
+    const char *trees = data + trees_offset;
+    static const char sparse_start[] = "<!--\nvomitorium-sparse-trees ";
+    bool sparse = memcmp(trees, sparse_start, strlen(sparse_start)) == 0;
+    size_t begin_size = sparse ? INDEX_SPARSE_TREES_BEGIN_SIZE : INDEX_TREES_BEGIN_SIZE;
+    size_t entry_size = sparse ? INDEX_SPARSE_TREE_SIZE : INDEX_TREE_SIZE;
+    if (trees_offset + begin_size > size - INDEX_FOOTER_SIZE)
+        return;
+    if (!parse_hex(trees + begin_size - 17, &entries))
+        return;
+    if (entries > (size - INDEX_FOOTER_SIZE - trees_offset - begin_size) / entry_size)
+        return;
+    const char *table = trees + begin_size;
+    tree_count = entries;
+    if (sparse)
+    {
+        // Ids are in order, so the last one says how many there could be.
+        size_t last = 0;
+        if (entries && !parse_hex(table + (entries - 1) * INDEX_SPARSE_TREE_SIZE, &last))
+            return;
+        tree_count = entries ? last + 1 : 0;
+    }
+
+    reader->has_index = true;
+    reader->have_records = true;
+    reader->records.swap(records);
+    reader->tree_table = table;
+    reader->tree_count = tree_count;
+    reader->sparse_trees = sparse;
+    reader->tree_entries = entries;
+}
+
+vomitorium_reader *vomitorium_reader_open(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return NULL;
+    }
+
+    const char *data = NULL;
+    if (st.st_size)
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            int e = errno;
+            close(fd);
+            errno = e;
+            return NULL;
+        }
+        data = (const char *)map;
+        // Mostly read front to back, even when split between threads.
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    vomitorium_reader *reader = new vomitorium_reader;
+    reader->data = data;
+    reader->size = st.st_size;
+    reader->has_index = false;
+    reader->have_records = false;
+    reader->tree_table = NULL;
+    reader->tree_count = 0;
+    reader->sparse_trees = false;
+    reader->tree_entries = 0;
+    read_index(reader);
+    return reader;
+}
+
+void vomitorium_reader_close(vomitorium_reader *reader)
+{
+    if (reader->size)
+        munmap((void *)reader->data, reader->size);
+    delete reader;
+}
+
+vomitorium_string_view vomitorium_reader_data(vomitorium_reader *reader)
+{
+    return make_view(reader->data, reader->size);
+}
+
+bool vomitorium_reader_has_index(vomitorium_reader *reader)
+{
+    return reader->has_index;
+}
+
+bool vomitorium_reader_parse(vomitorium_reader *reader, vomitorium_reader_handler *handler)
+{
+    vomitorium_tokens tokens(reader->data, reader->data + reader->size, false, false);
+    return dispatch(&tokens, handler);
+}
+
+
+// Without an index, find the records by parsing everything once.
+static void find_records(vomitorium_reader *reader)
+{
+    const char *p = reader->data;
+    const char *end = reader->data + reader->size;
+    vomitorium_reader_handler handler;
+    vomitorium_reader_handler_init(&handler);
+
+    while (p < end)
+    {
+        // Skip the <?xml?> line, comments and blank lines between records.
+        while (p < end && is_space(*p))
+            ++p;
+        if (p == end)
+            break;
+        if (end - p >= 4 && memcmp(p, "<!--", 4) == 0)
+        {
+            const char *q = find(p, end, "-->", 3);
+            if (!q)
+                break;
+            p = q + 3;
+            continue;
+        }
+        if (end - p >= 2 && p[1] == '?')
+        {
+            const char *q = find(p, end, "?>", 2);
+            if (!q)
+                break;
+            p = q + 2;
+            continue;
+        }
+        if (*p != '<')
+            break;
+
+        vomitorium_tokens tokens(p, end, true, false);
+        if (!dispatch(&tokens, &handler))
+            break;
+        const char *q = tokens.p;
+        if (q < end && *q == '\n')
+            ++q;
+
+        vomitorium_record record;
+        vomitorium_record_init(&record);
+        const char *tag = p + 1;
+        const char *tag_end = tag;
+        while (tag_end < end && is_name_char(*tag_end))
+            ++tag_end;
+        record.tag = make_view(tag, tag_end - tag);
+        record.offset = p - reader->data;
+        record.length = q - p;
+        reader->records.push_back(record);
+        p = q;
+    }
+    reader->have_records = true;
+}
+
+size_t vomitorium_reader_record_count(vomitorium_reader *reader)
+{
+    if (!reader->have_records)
+        find_records(reader);
+    return reader->records.size();
+}
+
+bool vomitorium_reader_record(vomitorium_reader *reader, size_t i, vomitorium_record *record)
+{
+    if (i >= vomitorium_reader_record_count(reader))
+        return false;
+    // Don't write past the end of an older, smaller struct,
+    // and leave its _size alone.
+    const vomitorium_record& full = reader->records[i];
+    size_t size = record->_size < sizeof(full) ? record->_size : sizeof(full);
+    memcpy((char *)record + sizeof(record->_size), (const char *)&full + sizeof(full._size), size - sizeof(full._size));
+    return true;
+}
+
+static bool record_range(vomitorium_reader *reader, size_t i, const char **begin, const char **end)
+{
+    if (i >= vomitorium_reader_record_count(reader))
+        return false;
+    const vomitorium_record& record = reader->records[i];
+    *begin = reader->data + record.offset;
+    *end = *begin + record.length;
+    return true;
+}
+
+bool vomitorium_reader_parse_record(vomitorium_reader *reader, size_t i, vomitorium_reader_handler *handler)
+{
+    const char *begin, *end;
+    if (!record_range(reader, i, &begin, &end))
+        return false;
+    vomitorium_tokens tokens(begin, end, true, false);
+    return dispatch(&tokens, handler);
+}
+
+
+size_t vomitorium_reader_tree_count(vomitorium_reader *reader)
+{
+    return reader->tree_count;
+}
+
+// Binary search for `id` in a sparse table.
+static bool sparse_tree_offset(vomitorium_reader *reader, size_t id, size_t *offset)
+{
+    size_t lo = 0, hi = reader->tree_entries;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        const char *entry = reader->tree_table + mid * INDEX_SPARSE_TREE_SIZE;
+        size_t entry_id;
+        if (!parse_hex(entry, &entry_id))
+            return false;
+        if (entry_id == id)
+            return parse_hex(entry + 17, offset);
+        if (entry_id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return false;
+}
+
+static bool tree_start(vomitorium_reader *reader, size_t id, const char **begin)
+{
+    if (id >= reader->tree_count)
+        return false;
+    size_t offset;
+    if (reader->sparse_trees)
+    {
+        if (!sparse_tree_offset(reader, id, &offset))
+            return false;
+    }
+    else if (!parse_hex(reader->tree_table + id * INDEX_TREE_SIZE, &offset))
+        return false;
+    if (offset == INDEX_TREE_ABSENT || offset >= reader->size)
+        return false;
+    *begin = reader->data + offset;
+    return true;
+}
+
+bool vomitorium_reader_parse_tree(vomitorium_reader *reader, size_t id, vomitorium_reader_handler *handler)
+{
+    const char *begin;
+    if (!tree_start(reader, id, &begin))
+        return false;
+    vomitorium_tokens tokens(begin, reader->data + reader->size, true, false);
+    return dispatch(&tokens, handler);
+}
+
+
+vomitorium_tokens *vomitorium_reader_tokens(vomitorium_reader *reader)
+{
+    return new vomitorium_tokens(reader->data, reader->data + reader->size, false, false);
+}
+
+vomitorium_tokens *vomitorium_reader_record_tokens(vomitorium_reader *reader, size_t i)
+{
+    const char *begin, *end;
+    if (!record_range(reader, i, &begin, &end))
+        return NULL;
+    return new vomitorium_tokens(begin, end, true, false);
+}
+
+vomitorium_tokens *vomitorium_reader_tree_tokens(vomitorium_reader *reader, size_t id)
+{
+    const char *begin;
+    if (!tree_start(reader, id, &begin))
+        return NULL;
+    return new vomitorium_tokens(begin, reader->data + reader->size, true, false);
+}
+
+vomitorium_tokens *vomitorium_reader_range_tokens(vomitorium_reader *reader, size_t offset, size_t length)
+{
+    if (offset > reader->size || length > reader->size - offset)
+        return NULL;
+    const char *begin = reader->data + offset;
+    return new vomitorium_tokens(begin, begin + length, false, true);
+}
+
+bool vomitorium_tokens_next(vomitorium_tokens *tokens, vomitorium_token *token)
+{
+    vomitorium_token full;
+    vomitorium_token_init(&full);
+    bool rv = tokens->next(&full);
+    if (!rv)
+        tokens->emit_none(&full);
+
+    // Don't write past the end of an older, smaller struct,
+    // and leave its _size alone.
+    size_t size = token->_size < sizeof(full) ? token->_size : sizeof(full);
+    memcpy((char *)token + sizeof(token->_size), (const char *)&full + sizeof(full._size), size - sizeof(full._size));
+    return rv;
+}
+
+bool vomitorium_tokens_complete(vomitorium_tokens *tokens)
+{
+    return tokens->complete();
+}
+
+void vomitorium_tokens_end(vomitorium_tokens *tokens)
+{
+    delete tokens;
+}
+
+bool vomitorium_reader_tree_ref(vomitorium_string_view ref, size_t *id)
+{
+    if (ref.len < 2 || ref.data[0] != '@')
+        return false;
+    size_t v = 0;
+    for (size_t i = 1; i < ref.len; ++i)
+    {
+        char c = ref.data[i];
+        if (c < '0' || '9' < c)
+            return false;
+        v = v * 10 + (c - '0');
+    }
+    *id = v;
+    return true;
+}
+
+size_t vomitorium_reader_unescape(vomitorium_string_view in, char *out)
+{
+    static const struct
+    {
+        const char *entity;
+        size_t len;
+        char c;
+    } entities[] =
+    {
+        {"&lt;", 4, '<'},
+        {"&gt;", 4, '>'},
+        {"&amp;", 5, '&'},
+        {"&quot;", 6, '"'},
+    };
+
+    size_t n = 0;
+    for (size_t i = 0; i < in.len; )
+    {
+        if (in.data[i] == '&')
+        {
+            bool found = false;
+            for (size_t e = 0; e < sizeof(entities) / sizeof(entities[0]) && !found; ++e)
+            {
+                if (in.len - i >= entities[e].len && memcmp(in.data + i, entities[e].entity, entities[e].len) == 0)
+                {
+                    out[n++] = entities[e].c;
+                    i += entities[e].len;
+                    found = true;
+                }
+            }
+            if (found)
+                continue;
+        }
+        out[n++] = in.data[i++];
+    }
+    return n;
+}
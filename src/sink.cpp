@@ -0,0 +1,82 @@
+#include "internal.hpp"
+
+#include <string>
+
+#include "buffer.hpp"
+#include "compress.hpp"
+
+
+// Lazy for the same reason as get_xml_output() in dump-v1.cpp:
+// vomitorium_output isn't known until plugin_init().
+OutputBuffer& get_output_buffer()
+{
+    static OutputBuffer global_buffer(vomitorium_output, false);
+    return global_buffer;
+}
+
+static const char *compress_name;
+static int compress_level;
+
+void set_output_compression(const char *name, int level)
+{
+    compress_name = name;
+    compress_level = level;
+}
+
+void compress_output(OutputBuffer *buffer, const char *path)
+{
+    if (!compress_name)
+        return;
+    Compressor *compressor = make_compressor(compress_name, compress_level);
+    if (!compressor)
+    {
+        fprintf(stderr, "Error: vomitorium can't do '%s' compression (it needs to be built with it)\n", compress_name);
+        exit(1);
+    }
+    FILE *frames = nullptr;
+    if (path)
+    {
+        std::string frames_path = std::string(path) + ".frames";
+        if (!(frames = fopen(frames_path.c_str(), "w")))
+        {
+            fprintf(stderr, "Error: vomitorium unable to open frame table '%s'\n", frames_path.c_str());
+            exit(1);
+        }
+    }
+    buffer->compress(compressor, frames);
+}
+
+static bool mmap_enabled;
+
+void set_output_mmap()
+{
+    mmap_enabled = true;
+}
+
+void mmap_output(OutputBuffer *buffer, const char *path)
+{
+    if (!mmap_enabled)
+        return;
+    if (!buffer->map_file())
+        fprintf(stderr, "Warning: vomitorium can't mmap output '%s' (not a regular file?), writing it normally\n", path ? path : "<stdout>");
+}
+
+char *vomitorium_sink_reserve(size_t len)
+{
+    return get_output_buffer().reserve(len);
+}
+
+void vomitorium_sink_commit(size_t len)
+{
+    get_output_buffer().commit(len);
+}
+
+void vomitorium_sink_append(const char *data, size_t len)
+{
+    get_output_buffer().append(data, len);
+}
+
+void vomitorium_sink_flush()
+{
+    get_output_buffer().flush();
+}
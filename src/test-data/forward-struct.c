@@ -0,0 +1,3 @@
+struct later;
+struct later *p;
+struct later { int a, b; };
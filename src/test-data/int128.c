@@ -0,0 +1,3 @@
+// Constants that don't fit in a HOST_WIDE_INT.
+unsigned __int128 all_ones = ~(unsigned __int128)0;
+__int128 big = (__int128)1 << 100;
@@ -0,0 +1,220 @@
+// DO NOT INCLUDE ANY GCC HEADERS
+
+#include "vomitorium-reader.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+#include <string>
+
+#include "index.hpp"
+
+
+static const char dump_record[] =
+    "<vomitorium-dump version=\"1\">\n"
+    "  <trees>\n"
+    "    <tree id=\"@0\"/>\n"
+    "    <tree id=\"@1\">\n"
+    "      <code>identifier_node</code>\n"
+    "      <name>a &lt; b</name>\n"
+    "      <type>@0</type>\n"
+    "    </tree>\n"
+    "  </trees>\n"
+    "</vomitorium-dump>\n";
+static const char gimple_record[] =
+    "<vomitorium-gimple version=\"1\">\n"
+    "  <function>@1</function>\n"
+    "</vomitorium-gimple>\n";
+
+enum IndexKind
+{
+    NO_INDEX,
+    DENSE_INDEX,
+    SPARSE_INDEX,
+};
+
+static std::string make_dump(IndexKind index)
+{
+    std::string out = "<?xml version=\"1.0\" encoding=\"ascii\"?>\n";
+    size_t dump_offset = out.size();
+    out += dump_record;
+    size_t gimple_offset = out.size();
+    out += gimple_record;
+    if (index == NO_INDEX)
+        return out;
+
+    char line[64];
+    size_t records_offset = out.size();
+    out += INDEX_RECORDS_BEGIN;
+    snprintf(line, sizeof(line), INDEX_RECORD_FORMAT, dump_offset, sizeof(dump_record) - 1, "vomitorium-dump");
+    out += line;
+    snprintf(line, sizeof(line), INDEX_RECORD_FORMAT, gimple_offset, sizeof(gimple_record) - 1, "vomitorium-gimple");
+    out += line;
+    out += INDEX_END;
+
+    size_t trees_offset = out.size();
+    if (index == SPARSE_INDEX)
+    {
+        // Just @1; @0 isn't in this file.
+        snprintf(line, sizeof(line), INDEX_SPARSE_TREES_BEGIN_FORMAT, (size_t)1);
+        out += line;
+        snprintf(line, sizeof(line), INDEX_SPARSE_TREE_FORMAT, (size_t)1, out.find("<tree id=\"@1\""));
+        out += line;
+    }
+    else
+    {
+        snprintf(line, sizeof(line), INDEX_TREES_BEGIN_FORMAT, (size_t)3);
+        out += line;
+        snprintf(line, sizeof(line), INDEX_TREE_FORMAT, out.find("<tree id=\"@0\""));
+        out += line;
+        snprintf(line, sizeof(line), INDEX_TREE_FORMAT, out.find("<tree id=\"@1\""));
+        out += line;
+        snprintf(line, sizeof(line), INDEX_TREE_FORMAT, INDEX_TREE_ABSENT);
+        out += line;
+    }
+    out += INDEX_END;
+
+    snprintf(line, sizeof(line), INDEX_FOOTER_FORMAT, records_offset, trees_offset);
+    out += line;
+    return out;
+}
+
+static vomitorium_reader *open_dump(IndexKind index)
+{
+    char path[] = "/tmp/test-reader-XXXXXX";
+    int fd = mkstemp(path);
+    assert (fd != -1);
+    FILE *f = fdopen(fd, "w");
+    std::string dump = make_dump(index);
+    fwrite(dump.data(), 1, dump.size(), f);
+    fclose(f);
+
+    vomitorium_reader *reader = vomitorium_reader_open(path);
+    assert (reader);
+    remove(path);
+    return reader;
+}
+
+
+static bool print_start(vomitorium_reader_handler *, vomitorium_string_view tag, vomitorium_string_view attr, vomitorium_string_view value)
+{
+    printf("start %.*s", (int)tag.len, tag.data);
+    if (attr.len)
+        printf(" %.*s=%.*s", (int)attr.len, attr.data, (int)value.len, value.data);
+    printf("\n");
+    return true;
+}
+static bool print_text(vomitorium_reader_handler *, vomitorium_string_view text)
+{
+    char buf[64];
+    assert (text.len <= sizeof(buf));
+    size_t len = vomitorium_reader_unescape(text, buf);
+    printf("text %.*s\n", (int)len, buf);
+    return true;
+}
+static bool print_end(vomitorium_reader_handler *, vomitorium_string_view tag)
+{
+    printf("end %.*s\n", (int)tag.len, tag.data);
+    return true;
+}
+
+static vomitorium_reader_handler printer()
+{
+    vomitorium_reader_handler handler;
+    vomitorium_reader_handler_init(&handler);
+    handler.start = print_start;
+    handler.text = print_text;
+    handler.end = print_end;
+    return handler;
+}
+
+
+static void test_parse()
+{
+    vomitorium_reader *reader = open_dump(NO_INDEX);
+    vomitorium_reader_handler handler = printer();
+    assert (!vomitorium_reader_has_index(reader));
+    assert (vomitorium_reader_parse(reader, &handler));
+    vomitorium_reader_close(reader);
+}
+
+static void test_records(bool with_index)
+{
+    vomitorium_reader *reader = open_dump(with_index ? DENSE_INDEX : NO_INDEX);
+    vomitorium_reader_handler handler = printer();
+    assert (vomitorium_reader_has_index(reader) == with_index);
+    assert (vomitorium_reader_record_count(reader) == 2);
+
+    vomitorium_record record;
+    vomitorium_record_init(&record);
+    assert (vomitorium_reader_record(reader, 1, &record));
+    assert (record.length == sizeof(gimple_record) - 1);
+    assert (memcmp(vomitorium_reader_data(reader).data + record.offset, gimple_record, record.length) == 0);
+    assert (!vomitorium_reader_record(reader, 2, &record));
+
+    assert (vomitorium_reader_parse_record(reader, 1, &handler));
+    vomitorium_reader_close(reader);
+}
+
+static void test_trees()
+{
+    vomitorium_reader *reader = open_dump(DENSE_INDEX);
+    vomitorium_reader_handler handler = printer();
+    assert (vomitorium_reader_tree_count(reader) == 3);
+    assert (vomitorium_reader_parse_tree(reader, 1, &handler));
+    assert (vomitorium_reader_parse_tree(reader, 0, &handler));
+    assert (!vomitorium_reader_parse_tree(reader, 2, &handler));
+    assert (!vomitorium_reader_parse_tree(reader, 3, &handler));
+
+    size_t id;
+    vomitorium_string_view ref = {"@123", 4};
+    assert (vomitorium_reader_tree_ref(ref, &id) && id == 123);
+    vomitorium_string_view bad = {"123", 3};
+    assert (!vomitorium_reader_tree_ref(bad, &id));
+    vomitorium_reader_close(reader);
+}
+
+static void test_sparse_trees()
+{
+    vomitorium_reader *reader = open_dump(SPARSE_INDEX);
+    vomitorium_reader_handler handler = printer();
+    assert (vomitorium_reader_has_index(reader));
+    assert (vomitorium_reader_record_count(reader) == 2);
+    assert (vomitorium_reader_tree_count(reader) == 2);
+    assert (vomitorium_reader_parse_tree(reader, 1, &handler));
+    assert (!vomitorium_reader_parse_tree(reader, 0, &handler));
+    assert (!vomitorium_reader_parse_tree(reader, 2, &handler));
+    vomitorium_reader_close(reader);
+}
+
+static void test_tokens()
+{
+    vomitorium_reader *reader = open_dump(DENSE_INDEX);
+    assert (!vomitorium_reader_tree_tokens(reader, 2));
+    vomitorium_tokens *tokens = vomitorium_reader_tree_tokens(reader, 1);
+    assert (tokens);
+
+    static const char *const kinds[] = {"none", "start", "text", "end"};
+    vomitorium_token token;
+    vomitorium_token_init(&token);
+    while (vomitorium_tokens_next(tokens, &token))
+    {
+        vomitorium_string_view v = token.kind == VOMITORIUM_TOKEN_TEXT ? token.text : token.tag;
+        printf("%zu %s %.*s\n", token.depth, kinds[token.kind], (int)v.len, v.data);
+    }
+    assert (token.kind == VOMITORIUM_TOKEN_NONE);
+    assert (vomitorium_tokens_complete(tokens));
+    vomitorium_tokens_end(tokens);
+    vomitorium_reader_close(reader);
+}
+
+int main()
+{
+    test_parse();
+    test_records(false);
+    test_records(true);
+    test_trees();
+    test_sparse_trees();
+    test_tokens();
+}
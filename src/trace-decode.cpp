@@ -0,0 +1,71 @@
+// Turn a binary trace from -fplugin-arg-vomitorium-trace=FILE into text.
+// DO NOT INCLUDE ANY GCC HEADERS
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#include "trace.hpp"
+
+
+static void die(const char *path, const char *what)
+{
+    fprintf(stderr, "%s: %s\n", path, what);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s TRACE-FILE\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[1];
+    FILE *in = fopen(path, "rb");
+    if (!in)
+        die(path, "unable to open");
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1)
+        die(path, "truncated header");
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)
+        die(path, "not a vomitorium trace");
+    if (header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord))
+        die(path, "unsupported trace version");
+
+    std::vector<std::string> names(header.name_count);
+    for (uint32_t i = 0; i < header.name_count; ++i)
+    {
+        int c;
+        while ((c = getc(in)) > 0)
+            names[i] += (char)c;
+        if (c < 0)
+            die(path, "truncated event names");
+    }
+
+    if (header.dropped)
+        printf("# %" PRIu64 " older records were dropped\n", header.dropped);
+
+    uint64_t start = 0;
+    uint64_t prev = 0;
+    TraceRecord r;
+    for (uint64_t i = 0; i < header.record_count; ++i)
+    {
+        if (fread(&r, sizeof(r), 1, in) != 1)
+            die(path, "truncated records");
+        if (i == 0)
+            start = prev = r.time_ns;
+        const char *name = r.event < names.size() ? names[r.event].c_str() : "?";
+        // seconds since the first record, microseconds since the previous
+        printf("%.9f +%.3f %s 0x%" PRIx64 "\n", (r.time_ns - start) / 1e9, (r.time_ns - prev) / 1e3, name, r.gcc_data);
+        prev = r.time_ns;
+    }
+    fclose(in);
+    if (fflush(stdout) != 0 || ferror(stdout))
+        die("<stdout>", "failed to write");
+}
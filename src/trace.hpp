@@ -0,0 +1,41 @@
+#pragma once
+
+// DO NOT INCLUDE ANY GCC HEADERS
+// (this is shared with the decoder)
+
+/*
+    Binary event trace, as written by -fplugin-arg-vomitorium-trace=FILE.
+
+    All in native byte order, since it is meant to be decoded on the
+    machine that produced it:
+
+        TraceHeader
+        name_count NUL-terminated event names, indexed by TraceRecord::event
+        record_count TraceRecords, oldest first
+*/
+#include <cstdint>
+
+#define TRACE_MAGIC "VOMTRACE"
+#define TRACE_VERSION 1
+
+struct TraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t name_count;
+    uint32_t _pad;
+    uint64_t record_count;
+    // Oldest records that were overwritten because the ring buffer was full.
+    uint64_t dropped;
+};
+
+struct TraceRecord
+{
+    // CLOCK_MONOTONIC
+    uint64_t time_ns;
+    uint32_t event;
+    uint32_t _pad;
+    // Only meaningful relative to other records from the same trace.
+    uint64_t gcc_data;
+};
@@ -2,16 +2,248 @@
 
 #include <cassert>
 
+#include <algorithm>
+#include <vector>
+
+#include "walk.hpp"
+
+
+struct vomitorium_iter
+{
+    TreeWalker walker;
+};
+
+
+static void visit_with(vomitorium_visitor *visitor, TreeWalker *walker)
+{
+    auto visit_tree = VOMITORIUM_VISITOR_GET_FIELD(visitor, visit_tree);
+    auto visit_again = VOMITORIUM_VISITOR_GET_FIELD(visitor, visit_again);
+    auto visit_string8 = VOMITORIUM_VISITOR_GET_FIELD(visitor, visit_string8);
+    auto visit_string16 = VOMITORIUM_VISITOR_GET_FIELD(visitor, visit_string16);
+    auto visit_string32 = VOMITORIUM_VISITOR_GET_FIELD(visitor, visit_string32);
+
+    // indexed by event id
+    std::vector<vomitorium_cookie> cookies;
+
+    vomitorium_event event;
+    vomitorium_event_init(&event);
+    while (walker->next(&event))
+    {
+        switch (event.kind)
+        {
+        case VOMITORIUM_EVENT_TREE:
+            {
+                vomitorium_cookie cookie = visit_tree ? visit_tree(visitor, event.name, event.t) : nullptr;
+                if (cookie == VOMITORIUM_SKIP)
+                    walker->skip();
+                if (event.id >= cookies.size())
+                    cookies.resize(event.id + 1);
+                cookies[event.id] = cookie;
+            }
+            break;
+        case VOMITORIUM_EVENT_AGAIN:
+            if (visit_again)
+                visit_again(visitor, event.name, cookies[event.id]);
+            break;
+        case VOMITORIUM_EVENT_STRING8:
+            if (visit_string8)
+                visit_string8(visitor, event.name, (const uint8_t *)event.str, event.len);
+            break;
+        case VOMITORIUM_EVENT_STRING16:
+            if (visit_string16)
+                visit_string16(visitor, event.name, (const uint16_t *)event.str, event.len);
+            break;
+        case VOMITORIUM_EVENT_STRING32:
+            if (visit_string32)
+                visit_string32(visitor, event.name, (const uint32_t *)event.str, event.len);
+            break;
+        case VOMITORIUM_EVENT_NONE:
+            abort();
+        }
+    }
+}
+
+// One visitor's view of a walk that is shared with other visitors.
+//
+// The walk only skips a tree if *every* visitor asked to, so each visitor
+// has to hide the parts it didn't want, and keep its own idea of which
+// trees it has already seen.
+//
+// That also means a tree can be new to this visitor, but not to the walk,
+// if another visitor got to it inside a subtree that this one skipped.
+// Then the walk has to descend into it again, so that this visitor sees
+// the same subtree it would have on a walk of its own; everyone else
+// hides it.
+class SharedVisit
+{
+    vomitorium_visitor *visitor;
+    vomitorium_cookie (*visit_tree)(vomitorium_visitor *self, const char *name, tree t);
+    void (*visit_again)(vomitorium_visitor *self, const char *name, vomitorium_cookie t);
+    void (*visit_string8)(vomitorium_visitor *self, const char *name, const uint8_t *str, size_t len);
+    void (*visit_string16)(vomitorium_visitor *self, const char *name, const uint16_t *str, size_t len);
+    void (*visit_string32)(vomitorium_visitor *self, const char *name, const uint32_t *str, size_t len);
+
+    // indexed by event id
+    std::vector<vomitorium_cookie> cookies;
+    std::vector<bool> seen;
+
+    // Events deeper than this are hidden, because the visitor
+    // returned VOMITORIUM_SKIP for their ancestor.
+    size_t hide_below;
+    bool hiding;
+public:
+    SharedVisit(vomitorium_visitor *v)
+    : visitor(v)
+    , visit_tree(VOMITORIUM_VISITOR_GET_FIELD(v, visit_tree))
+    , visit_again(VOMITORIUM_VISITOR_GET_FIELD(v, visit_again))
+    , visit_string8(VOMITORIUM_VISITOR_GET_FIELD(v, visit_string8))
+    , visit_string16(VOMITORIUM_VISITOR_GET_FIELD(v, visit_string16))
+    , visit_string32(VOMITORIUM_VISITOR_GET_FIELD(v, visit_string32))
+    , hide_below(0)
+    , hiding(false)
+    {
+    }
+
+    // Returns true if this visitor wants the children of the event's tree.
+    bool dispatch(const vomitorium_event& event);
+private:
+    void hide(size_t depth)
+    {
+        this->hiding = true;
+        this->hide_below = depth;
+    }
+};
+
+bool SharedVisit::dispatch(const vomitorium_event& event)
+{
+    if (this->hiding)
+    {
+        if (event.depth > this->hide_below)
+            return false;
+        this->hiding = false;
+    }
+
+    switch (event.kind)
+    {
+    case VOMITORIUM_EVENT_TREE:
+    case VOMITORIUM_EVENT_AGAIN:
+        if (event.id >= this->seen.size())
+        {
+            this->seen.resize(event.id + 1);
+            this->cookies.resize(event.id + 1);
+        }
+        if (this->seen[event.id])
+        {
+            if (this->visit_again)
+                this->visit_again(this->visitor, event.name, this->cookies[event.id]);
+            // Another visitor may still have the walk descend into it.
+            this->hide(event.depth);
+            return false;
+        }
+        // Even for an AGAIN event, *this* visitor might not have seen it,
+        // if it was first reached inside a subtree that this visitor hid.
+        this->seen[event.id] = true;
+        {
+            vomitorium_cookie cookie = this->visit_tree ? this->visit_tree(this->visitor, event.name, event.t) : nullptr;
+            this->cookies[event.id] = cookie;
+            if (cookie == VOMITORIUM_SKIP)
+            {
+                this->hide(event.depth);
+                return false;
+            }
+        }
+        return true;
+    case VOMITORIUM_EVENT_STRING8:
+        if (this->visit_string8)
+            this->visit_string8(this->visitor, event.name, (const uint8_t *)event.str, event.len);
+        return false;
+    case VOMITORIUM_EVENT_STRING16:
+        if (this->visit_string16)
+            this->visit_string16(this->visitor, event.name, (const uint16_t *)event.str, event.len);
+        return false;
+    case VOMITORIUM_EVENT_STRING32:
+        if (this->visit_string32)
+            this->visit_string32(this->visitor, event.name, (const uint32_t *)event.str, event.len);
+        return false;
+    case VOMITORIUM_EVENT_NONE:
+        break;
+    }
+    abort();
+}
 
 void vomitorium_visit(vomitorium_visitor *visitor, tree object)
 {
-    (void)visitor;
-    (void)object;
-    assert (!"NYI");
+    TreeWalker walker;
+    walker.add_root("root", object);
+    visit_with(visitor, &walker);
 }
 
 void vomitorium_visit_all(vomitorium_visitor *visitor)
 {
-    assert (!"NYI");
-    (void)visitor;
+    TreeWalker walker;
+    walker.add_global_roots();
+    visit_with(visitor, &walker);
+}
+
+void vomitorium_visit_all_multi(vomitorium_visitor **visitors, size_t n)
+{
+    std::vector<SharedVisit> shared;
+    shared.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        shared.push_back(SharedVisit(visitors[i]));
+
+    TreeWalker walker;
+    walker.add_global_roots();
+
+    vomitorium_event event;
+    vomitorium_event_init(&event);
+    while (walker.next(&event))
+    {
+        bool wanted = false;
+        for (size_t i = 0; i < n; ++i)
+            wanted |= shared[i].dispatch(event);
+        if (event.kind == VOMITORIUM_EVENT_TREE && !wanted)
+            walker.skip();
+        if (event.kind == VOMITORIUM_EVENT_AGAIN && wanted)
+            walker.descend();
+    }
+}
+
+
+vomitorium_iter *vomitorium_iter_begin(tree root)
+{
+    vomitorium_iter *it = new vomitorium_iter;
+    it->walker.add_root("root", root);
+    return it;
+}
+
+vomitorium_iter *vomitorium_iter_begin_all()
+{
+    vomitorium_iter *it = new vomitorium_iter;
+    it->walker.add_global_roots();
+    return it;
+}
+
+bool vomitorium_iter_next(vomitorium_iter *it, vomitorium_event *event)
+{
+    vomitorium_event full;
+    vomitorium_event_init(&full);
+    bool rv = it->walker.next(&full);
+
+    // Don't write past the end of an older, smaller struct,
+    // and leave its _size alone.
+    assert (event->_size >= sizeof(event->_size));
+    size_t size = std::min(event->_size, sizeof(full));
+    memcpy((char *)event + sizeof(event->_size), (const char *)&full + sizeof(full._size), size - sizeof(full._size));
+    return rv;
+}
+
+void vomitorium_iter_skip(vomitorium_iter *it)
+{
+    it->walker.skip();
+}
+
+void vomitorium_iter_end(vomitorium_iter *it)
+{
+    delete it;
 }
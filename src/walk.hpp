@@ -0,0 +1,9 @@
+#pragma once
+
+#include "internal.hpp"
+
+#include "vomitorium-walk.hpp"
+
+
+// vomitorium's own copy of the walk.
+typedef VomitoriumWalker TreeWalker;
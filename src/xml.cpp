@@ -6,34 +6,44 @@
 
 #include <algorithm>
 
+#include "buffer.hpp"
 
-XmlOutput::XmlOutput(FILE *out, bool close)
-: output_file(out)
-, should_close(close)
-, in_tag(false)
-, in_attribute(false)
-, start_of_line(true)
-, soft_newline(false)
-, current_indent(0)
-, indent_spaces(2) // or 4, we don't actually indent much.
+
+void XmlOutput::init(OutputBuffer *buf, bool owns)
 {
-    if (!out)
-        abort();
+    this->buffer = buf;
+    this->owns_buffer = owns;
+    this->in_tag = false;
+    this->in_attribute = false;
+    this->start_of_line = true;
+    this->soft_newline = false;
+    this->current_indent = 0;
+    this->indent_spaces = 2; // or 4, we don't actually indent much.
 
     this->emit_raw("<?xml version=\"1.0\" encoding=\"ascii\"?>", 38);
     this->emit_newline();
 }
 
+XmlOutput::XmlOutput(FILE *out, bool close)
+{
+    this->init(new OutputBuffer(out, close), true);
+}
+
+XmlOutput::XmlOutput(OutputBuffer *buf)
+{
+    this->init(buf, false);
+}
+
 XmlOutput::~XmlOutput()
 {
     assert (!this->in_tag);
     assert (!this->in_attribute);
     assert (this->current_indent == 0);
     this->flush();
-    if (this->should_close)
-        fclose(this->output_file);
+    if (this->owns_buffer)
+        delete this->buffer;
     else
-        fflush(this->output_file);
+        this->buffer->flush();
 }
 
 void XmlOutput::flush()
@@ -57,24 +67,15 @@ void XmlOutput::emit_spaces(size_t n)
     while (n)
     {
         size_t l = std::min(n, strlen(many_spaces));
-        size_t rv = fwrite(many_spaces, 1, l, this->output_file);
-        if (rv <= 0)
-            abort();
-        n -= rv;
+        this->buffer->append(many_spaces, l);
+        n -= l;
     }
 }
 
 void XmlOutput::emit_raw(const char *s, size_t len)
 {
     this->flush();
-    while (len)
-    {
-        size_t rv = fwrite(s, 1, len, this->output_file);
-        if (rv == 0)
-            abort();
-        s += rv;
-        len -= rv;
-    }
+    this->buffer->append(s, len);
 }
 
 void XmlOutput::emit_newline()
@@ -129,19 +130,23 @@ void XmlOutput::emit_string(const char *s)
     }
 }
 
+size_t XmlOutput::prepare_tag()
+{
+    // this->in_tag may be true or false; this->flush() will handle it.
+    assert (!this->in_attribute);
+
+    if (this->soft_newline)
+        this->emit_newline();
+    this->flush();
+    return this->buffer->tell();
+}
+
 
 XmlTag::XmlTag(XmlOutput *o, const char *t)
 : out(o)
 , tag(t)
 {
-    // out->in_tag may be true or false; out->flush() will handle it.
-    assert (!out->in_attribute);
-
-    if (out->soft_newline)
-        out->emit_newline();
-    else
-        out->flush();
-
+    out->prepare_tag();
     out->emit_raw("<", 1);
     out->emit_string(this->tag);
 
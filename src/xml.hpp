@@ -13,6 +13,7 @@
 */
 #include <cstdio>
 
+class OutputBuffer;
 class XmlTag;
 class XmlAttr;
 
@@ -21,8 +22,8 @@ class XmlOutput
     friend class XmlTag;
     friend class XmlAttr;
 
-    FILE *output_file;
-    bool should_close : 1;
+    OutputBuffer *buffer;
+    bool owns_buffer : 1;
 
     bool in_tag : 1;
     bool in_attribute : 1;
@@ -32,8 +33,12 @@ class XmlOutput
 
     size_t current_indent;
     size_t indent_spaces;
+
+    void init(OutputBuffer *buf, bool owns);
 public:
     XmlOutput(FILE *out, bool should_close);
+    // Share a buffer with other writers; it must outlive us.
+    XmlOutput(OutputBuffer *buffer);
     XmlOutput(const XmlOutput&) = delete;
     XmlOutput& operator = (const XmlOutput&) = delete;
     ~XmlOutput();
@@ -45,8 +50,9 @@ public:
     void emit_newline();
     void emit_string(const char *s);
 
-    template<class F>
-    void with_output_file(F&& f);
+    // Emit whatever has to come before a new tag (newline, indentation),
+    // and return the offset in the buffer that the tag will start at.
+    size_t prepare_tag();
 
     XmlTag tag(const char *t);
     XmlAttr attr(const char *a);
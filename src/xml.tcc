@@ -5,12 +5,6 @@
 #include "compat.hpp"
 
 
-template<class F>
-void XmlOutput::with_output_file(F&& f)
-{
-    this->flush();
-    std::forward<F>(f)(this->output_file);
-}
 inline XmlTag XmlOutput::tag(const char *t)
 {
     return XmlTag(this, t);